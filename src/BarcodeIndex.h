@@ -0,0 +1,288 @@
+// BarcodeIndex.h
+
+#ifndef FLEXBAR_BARCODEINDEX_H
+#define FLEXBAR_BARCODEINDEX_H
+
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+
+
+// Hash table of all sequences within a number of mismatches of barcodes with
+// equal length, mapped to nearest barcode. Sequences with the same distance to
+// two barcodes are marked as ambiguous.
+
+class BarcodeHash {
+
+private:
+	
+	struct Entry {
+		int index, mismatches;
+	};
+	
+	int m_length, m_maxMismatches;
+	
+	std::vector<std::vector<int16_t> > m_barcodes;
+	std::unordered_map<uint64_t, Entry> m_table;
+	
+	
+	static uint64_t getKey(const int16_t *seq, const int len){
+		
+		uint64_t key = 0;
+		
+		for(int i = 0; i < len; ++i) key = (key << 2) | seq[i];
+		
+		return key;
+	}
+	
+	
+	void insert(const uint64_t key, const int index, const int mismatches){
+		
+		std::unordered_map<uint64_t, Entry>::iterator it = m_table.find(key);
+		
+		if(it == m_table.end()){
+			Entry e = { index, mismatches };
+			m_table[key] = e;
+		}
+		else if(mismatches < it->second.mismatches){
+			it->second.index      = index;
+			it->second.mismatches = mismatches;
+		}
+		else if(mismatches == it->second.mismatches && index != it->second.index){
+			it->second.index = -1;
+		}
+	}
+	
+	
+	// substitutes positions from pos onwards, up to remaining mismatches
+	
+	void insertNeighbours(const uint64_t key, const int index, const int pos, const int mismatches){
+		
+		insert(key, index, mismatches);
+		
+		if(mismatches == m_maxMismatches) return;
+		
+		for(int i = pos; i < m_length; ++i){
+			
+			const int shift = 2 * (m_length - 1 - i);
+			const uint64_t c = (key >> shift) & 3;
+			
+			for(uint64_t d = 0; d < 4; ++d){
+				if(d != c) insertNeighbours((key & ~(3ull << shift)) | (d << shift), index, i + 1, mismatches + 1);
+			}
+		}
+	}
+	
+	
+	static long binomial(const int n, const int k){
+		
+		long b = 1;
+		
+		for(int i = 1; i <= k; ++i) b = b * (n - k + i) / i;
+		
+		return b;
+	}
+	
+public:
+	
+	BarcodeHash() :
+		m_length(0),
+		m_maxMismatches(0){
+	};
+	
+	
+	void addBarcode(const std::vector<int16_t> &barcode){
+		m_barcodes.push_back(barcode);
+	}
+	
+	
+	// barcodes need equal length of at most 32 without N, neighbourhood is
+	// restricted to a few million sequences
+	
+	bool build(const int maxMismatches){
+		
+		const long maxEntries = 1 << 22;
+		
+		m_table.clear();
+		m_length = 0;
+		
+		if(m_barcodes.size() == 0) return false;
+		
+		const int len = m_barcodes[0].size();
+		
+		for(unsigned int b = 0; b < m_barcodes.size(); ++b){
+			
+			if((int) m_barcodes[b].size() != len || len < 1 || len > 32) return false;
+			
+			for(int i = 0; i < len; ++i)
+				if(m_barcodes[b][i] > 3) return false;
+		}
+		
+		m_length        = len;
+		m_maxMismatches = 0;
+		
+		long entries = m_barcodes.size();
+		
+		for(int k = 1; k <= maxMismatches && k <= len; ++k){
+			
+			long n = binomial(len, k);
+			for(int i = 0; i < k; ++i) n *= 3;
+			
+			if(entries + n * m_barcodes.size() > maxEntries) break;
+			
+			entries += n * m_barcodes.size();
+			m_maxMismatches = k;
+		}
+		
+		m_table.reserve(entries);
+		
+		for(unsigned int b = 0; b < m_barcodes.size(); ++b)
+			insertNeighbours(getKey(&m_barcodes[b][0], len), b, 0, 0);
+		
+		return true;
+	}
+	
+	
+	int getLength() const {
+		return m_length;
+	}
+	
+	
+	int getMaxMismatches() const {
+		return m_maxMismatches;
+	}
+	
+	
+	// index of unique nearest barcode for sequence of barcode length
+	
+	bool lookup(int &index, int &mismatches, const int16_t *seq, const int len) const {
+		
+		if(m_length == 0 || len != m_length) return false;
+		
+		for(int i = 0; i < len; ++i)
+			if(seq[i] > 3) return false;
+		
+		std::unordered_map<uint64_t, Entry>::const_iterator it = m_table.find(getKey(seq, len));
+		
+		if(it == m_table.end() || it->second.index < 0) return false;
+		
+		index      = it->second.index;
+		mismatches = it->second.mismatches;
+		
+		return true;
+	}
+};
+
+// Trie of barcodes searched by edit distance to the start of a read tail with
+// free read start. Subtrees are pruned once all distances of a row exceed the
+// error bound, so only barcodes close to the tail are visited. Codes 0 to 3 are
+// nucleotides, N of barcodes matches any read code. Positions of barcodes that
+// overhang the read are placed before the text and match any barcode code.
+
+class BarcodeTrie {
+
+private:
+	
+	struct Node {
+		
+		int child[5];
+		std::vector<unsigned int> barcodes;
+		
+		Node(){
+			for(int c = 0; c < 5; ++c) child[c] = -1;
+		}
+	};
+	
+	std::vector<Node> m_nodes;
+	int m_maxLength;
+	
+	
+	void search(std::vector<std::pair<int, unsigned int> > &hits, std::vector<int> &rows, const int node, const int depth, const int16_t *text, const int w, const int overhang, const int maxErrors) const {
+		
+		const int *prev = &rows[depth * (w + 1)];
+		
+		if(m_nodes[node].barcodes.size() > 0){
+			
+			const int dist = *std::min_element(prev, prev + w + 1);
+			
+			if(dist <= maxErrors){
+				for(unsigned int b = 0; b < m_nodes[node].barcodes.size(); ++b)
+					hits.push_back(std::make_pair(dist, m_nodes[node].barcodes[b]));
+			}
+		}
+		
+		for(int c = 0; c < 5; ++c){
+			
+			const int child = m_nodes[node].child[c];
+			
+			if(child < 0) continue;
+			
+			int *cur = &rows[(depth + 1) * (w + 1)];
+			
+			cur[0] = prev[0] + 1;
+			int best = cur[0];
+			
+			for(int j = 1; j <= w; ++j){
+				
+				const int sub = prev[j - 1] + ((j <= overhang || text[j - 1 - overhang] == c || c == 4) ? 0 : 1);
+				
+				cur[j] = std::min(sub, std::min(prev[j], cur[j - 1]) + 1);
+				best   = std::min(best, cur[j]);
+			}
+			
+			if(best <= maxErrors) search(hits, rows, child, depth + 1, text, w, overhang, maxErrors);
+		}
+	}
+	
+public:
+	
+	BarcodeTrie() :
+		m_nodes(1),
+		m_maxLength(0){
+	};
+	
+	
+	void addBarcode(const std::vector<int16_t> &barcode, const unsigned int index){
+		
+		int node = 0;
+		
+		for(unsigned int i = 0; i < barcode.size(); ++i){
+			
+			const int c = std::min<int>(barcode[i], 4);
+			
+			if(m_nodes[node].child[c] < 0){
+				m_nodes[node].child[c] = m_nodes.size();
+				m_nodes.push_back(Node());
+			}
+			node = m_nodes[node].child[c];
+		}
+		
+		m_nodes[node].barcodes.push_back(index);
+		m_maxLength = std::max<int>(m_maxLength, barcode.size());
+	}
+	
+	
+	int getMaxLength() const {
+		return m_maxLength;
+	}
+	
+	
+	// barcodes with edit distance up to maxErrors, sorted by distance and index,
+	// text of length w follows overhang positions, rows are reused by caller
+	
+	void find(std::vector<std::pair<int, unsigned int> > &hits, std::vector<int> &rows, const int16_t *text, const int w, const int overhang, const int maxErrors) const {
+		
+		hits.clear();
+		
+		rows.resize((m_maxLength + 1) * (w + overhang + 1));
+		std::fill(rows.begin(), rows.begin() + w + overhang + 1, 0);
+		
+		search(hits, rows, 0, 0, text, w + overhang, overhang, maxErrors);
+		
+		std::sort(hits.begin(), hits.end());
+	}
+};
+
+
+#endif
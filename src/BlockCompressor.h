@@ -0,0 +1,179 @@
+// BlockCompressor.h
+
+#ifndef FLEXBAR_BLOCKCOMPRESSOR_H
+#define FLEXBAR_BLOCKCOMPRESSOR_H
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#if SEQAN_HAS_ZLIB
+	#include <zlib.h>
+#endif
+
+#if SEQAN_HAS_BZIP2
+	#include <bzlib.h>
+#endif
+
+#if FLEXBAR_HAS_ZSTD
+	#include <zstd.h>
+#endif
+
+
+// Compression of output data in blocks that can be concatenated. Gz output
+// consists of bgzf blocks with end of file marker, which is a valid multi-member
+// gzip file. Bz2 output consists of one bzip2 stream per block, as concatenated
+// by bzip2 tools. Zst output consists of one frame per block. Records of each
+// bundle are compressed in the parallel format stage and written in order by
+// the output stage. Level 0 selects the default level of each format.
+
+class BlockCompressor {
+
+private:
+	
+	static void putUInt16(std::string &s, const unsigned int v){
+		s += (char) (v & 0xff);
+		s += (char) ((v >> 8) & 0xff);
+	}
+	
+	static void putUInt32(std::string &s, const unsigned long v){
+		putUInt16(s, v & 0xffff);
+		putUInt16(s, (v >> 16) & 0xffff);
+	}
+	
+	
+	static bool compressBgzf(std::string &out, const char *in, const unsigned int n, const int level){
+	
+	#if SEQAN_HAS_ZLIB
+		const unsigned int maxBlock = 65536, headerSize = 18, footerSize = 8;
+		
+		const size_t start = out.size();
+		
+		out.resize(start + maxBlock);
+		
+		z_stream zs;
+		zs.zalloc = Z_NULL;
+		zs.zfree  = Z_NULL;
+		zs.opaque = Z_NULL;
+		
+		if(deflateInit2(&zs, level > 0 ? level : Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) return false;
+		
+		zs.next_in   = reinterpret_cast<unsigned char*>(const_cast<char*>(in));
+		zs.avail_in  = n;
+		zs.next_out  = reinterpret_cast<unsigned char*>(&out[start + headerSize]);
+		zs.avail_out = maxBlock - headerSize - footerSize;
+		
+		const int status = deflate(&zs, Z_FINISH);
+		
+		deflateEnd(&zs);
+		
+		if(status != Z_STREAM_END) return false;
+		
+		const unsigned int blockSize = headerSize + zs.total_out + footerSize;
+		
+		out.resize(start + headerSize + zs.total_out);
+		
+		const unsigned char header[16] = { 31, 139, 8, 4, 0, 0, 0, 0, 0, 255, 6, 0, 'B', 'C', 2, 0 };
+		
+		out.replace(start, 16, reinterpret_cast<const char*>(header), 16);
+		out[start + 16] = (char) ((blockSize - 1) & 0xff);
+		out[start + 17] = (char) ((blockSize - 1) >> 8);
+		
+		putUInt32(out, crc32(0, reinterpret_cast<const unsigned char*>(in), n));
+		putUInt32(out, n);
+		
+		return true;
+	#else
+		return false;
+	#endif
+	}
+	
+	
+	static bool compressBzip2(std::string &out, const char *in, const unsigned int n, const int level){
+	
+	#if SEQAN_HAS_BZIP2
+		unsigned int outSize = n + n / 100 + 600;
+		
+		const size_t start = out.size();
+		
+		out.resize(start + outSize);
+		
+		const int status = BZ2_bzBuffToBuffCompress(&out[start], &outSize, const_cast<char*>(in), n, level > 0 ? level : 9, 0, 0);
+		
+		if(status != BZ_OK) return false;
+		
+		out.resize(start + outSize);
+		
+		return true;
+	#else
+		return false;
+	#endif
+	}
+	
+	
+	static bool compressZstd(std::string &out, const char *in, const unsigned int n, const int level){
+	
+	#if FLEXBAR_HAS_ZSTD
+		const size_t start = out.size();
+		
+		out.resize(start + ZSTD_compressBound(n));
+		
+		const size_t outSize = ZSTD_compress(&out[start], out.size() - start, in, n, level > 0 ? level : 3);
+		
+		if(ZSTD_isError(outSize)) return false;
+		
+		out.resize(start + outSize);
+		
+		return true;
+	#else
+		return false;
+	#endif
+	}
+	
+public:
+	
+	// size of uncompressed data per block
+	
+	static unsigned int getBlockSize(const flexbar::CompressionType cmprsType){
+		
+		if(cmprsType == flexbar::GZ)  return 65280;
+		if(cmprsType == flexbar::BZ2) return 900000;
+		
+		return 1048576;
+	}
+	
+	
+	// appends data cut into compressed blocks to out, called in parallel
+	
+	static bool compress(std::string &out, const char *data, const size_t n, const flexbar::CompressionType cmprsType, const int level){
+		
+		const unsigned int blockSize = getBlockSize(cmprsType);
+		
+		for(size_t pos = 0; pos < n; pos += blockSize){
+			
+			const unsigned int size = std::min<size_t>(blockSize, n - pos);
+			
+			bool ok;
+			
+			     if(cmprsType == flexbar::GZ)  ok = compressBgzf(out, data + pos, size, level);
+			else if(cmprsType == flexbar::BZ2) ok = compressBzip2(out, data + pos, size, level);
+			else                               ok = compressZstd(out, data + pos, size, level);
+			
+			if(! ok) return false;
+		}
+		return true;
+	}
+	
+	
+	// empty bgzf block marks end of gz file, other formats need no marker
+	
+	static bool appendEof(std::string &out, const flexbar::CompressionType cmprsType){
+		
+		if(cmprsType != flexbar::GZ) return true;
+		
+		return compressBgzf(out, NULL, 0, 0);
+	}
+};
+
+
+#endif
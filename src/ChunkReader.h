@@ -0,0 +1,121 @@
+// ChunkReader.h
+
+#ifndef FLEXBAR_CHUNKREADER_H
+#define FLEXBAR_CHUNKREADER_H
+
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <cstdlib>
+#include <thread>
+#include <atomic>
+#include <tbb/concurrent_queue.h>
+
+
+// Decompression of files ahead of parsing in a background thread. Subclasses
+// implement the decompression loop in run, which reads from the file and pushes
+// chunks in order through a bounded queue until end of file, failure or stop.
+
+class ChunkReader {
+
+private:
+	
+	const std::string m_format;
+	std::thread m_thread;
+	
+	
+	void runThread(){
+		
+		run();
+		
+		m_chunks.push(NULL);
+	}
+	
+protected:
+	
+	std::ifstream m_file;
+	std::atomic<bool> m_failed, m_stop;
+	
+	// NULL marks end of file
+	tbb::concurrent_bounded_queue<std::string*> m_chunks;
+	
+	
+	virtual void run() = 0;
+	
+	
+	// remaining chunks are discarded until end is marked, subclasses call this
+	// in their destructor before their members are destroyed
+	
+	void stop(){
+		
+		if(! m_thread.joinable()) return;
+		
+		m_stop = true;
+		
+		std::string *chunk;
+		
+		while(true){
+			m_chunks.pop(chunk);
+			
+			if(chunk == NULL) break;
+			delete chunk;
+		}
+		
+		m_thread.join();
+	}
+	
+public:
+	
+	ChunkReader(const std::string &format) :
+		m_format(format),
+		m_failed(false),
+		m_stop(false){
+		
+		m_chunks.set_capacity(4);
+	};
+	
+	
+	virtual ~ChunkReader(){
+		stop();
+	};
+	
+	
+	bool open(const std::string &path){
+		
+		m_file.open(path.c_str(), std::ios::in | std::ios::binary);
+		
+		if(! m_file.good()) return false;
+		
+		m_thread = std::thread(&ChunkReader::runThread, this);
+		
+		return true;
+	}
+	
+	
+	// appends next decompressed chunk, false at end of file
+	
+	bool read(std::string &buffer){
+		
+		std::string *chunk;
+		
+		m_chunks.pop(chunk);
+		
+		if(chunk == NULL){
+			m_thread.join();
+			
+			if(m_failed){
+				std::cerr << "\nERROR: Decompression of " << m_format << " input failed.\n" << std::endl;
+				exit(1);
+			}
+			return false;
+		}
+		
+		buffer.append(*chunk);
+		delete chunk;
+		
+		return true;
+	}
+};
+
+
+#endif
@@ -0,0 +1,207 @@
+// DemuxWriter.h
+
+#ifndef FLEXBAR_DEMUXWRITER_H
+#define FLEXBAR_DEMUXWRITER_H
+
+#include <string>
+#include <vector>
+#include <list>
+#include <fstream>
+#include <iostream>
+#include <cstdlib>
+
+#include "BlockCompressor.h"
+
+
+// Output files of barcoded runs. Records are collected per file in memory and
+// written in large chunks. Files are created on first write and only a limited
+// number of them is kept open, the least recently written file is closed and
+// later reopened for appending. Compressed output arrives as blocks of bundles
+// that were compressed by the format stage and can be concatenated.
+
+class DemuxWriter {
+
+private:
+	
+	struct OutFile {
+		std::string path, pending;
+		std::ofstream *handle;
+		std::list<unsigned int>::iterator lruPos;
+		bool created;
+	};
+	
+	const flexbar::CompressionType m_cmprsType;
+	const unsigned int m_maxOpen;
+	
+	// pending data of single file and of all files until written
+	const unsigned long m_chunkSize, m_maxPending;
+	unsigned long m_nPending;
+	
+	std::vector<OutFile> m_files;
+	
+	// open files, most recently written first
+	std::list<unsigned int> m_open;
+	
+	bool m_closed;
+	
+	
+	std::ofstream* getHandle(const unsigned int id){
+		
+		using namespace std;
+		
+		OutFile &f = m_files[id];
+		
+		if(f.handle != NULL){
+			m_open.splice(m_open.begin(), m_open, f.lruPos);
+			return f.handle;
+		}
+		
+		if(m_open.size() >= m_maxOpen) closeHandle(m_open.back());
+		
+		ios::openmode mode = ios::out | ios::binary;
+		
+		if(f.created) mode |= ios::app;
+		
+		f.handle  = new ofstream(f.path.c_str(), mode);
+		f.created = true;
+		
+		if(! f.handle->good()){
+			cerr << "\nERROR: Could not open file " << f.path << "\n" << endl;
+			exit(1);
+		}
+		
+		m_open.push_front(id);
+		f.lruPos = m_open.begin();
+		
+		return f.handle;
+	}
+	
+	
+	void closeHandle(const unsigned int id){
+		
+		OutFile &f = m_files[id];
+		
+		if(f.handle == NULL) return;
+		
+		f.handle->close();
+		
+		if(f.handle->fail()){
+			std::cerr << "\nERROR: Could not write to file " << f.path << "\n" << std::endl;
+			exit(1);
+		}
+		
+		delete f.handle;
+		f.handle = NULL;
+		
+		m_open.erase(f.lruPos);
+	}
+	
+	
+	void writeData(const unsigned int id, const std::string &data){
+		
+		std::ofstream *handle = getHandle(id);
+		
+		handle->write(data.data(), data.size());
+		
+		if(! handle->good()){
+			std::cerr << "\nERROR: Could not write to file " << m_files[id].path << "\n" << std::endl;
+			exit(1);
+		}
+	}
+	
+	
+	bool hasData(const unsigned int id) const {
+		return m_files[id].created || m_files[id].pending.size() > 0;
+	}
+	
+	
+	void flush(const unsigned int id){
+		
+		OutFile &f = m_files[id];
+		
+		if(f.pending.size() == 0) return;
+		
+		writeData(id, f.pending);
+		
+		m_nPending -= f.pending.size();
+		f.pending.clear();
+	}
+	
+public:
+	
+	// maxPending in bytes
+	
+	DemuxWriter(const flexbar::CompressionType cmprsType, const unsigned int maxOpen, const unsigned long maxPending) :
+		m_cmprsType(cmprsType),
+		m_maxOpen(maxOpen > 0 ? maxOpen : 1),
+		m_chunkSize(1048576),
+		m_maxPending(maxPending),
+		m_nPending(0),
+		m_closed(false){
+	};
+	
+	
+	virtual ~DemuxWriter(){
+		close();
+	};
+	
+	
+	// registers file without creating it, returns id of file
+	
+	unsigned int addFile(const std::string &path){
+		
+		OutFile f;
+		f.path    = path;
+		f.handle  = NULL;
+		f.created = false;
+		
+		m_files.push_back(f);
+		
+		return m_files.size() - 1;
+	}
+	
+	
+	void write(const unsigned int id, const char *data, const size_t n){
+		
+		OutFile &f = m_files[id];
+		
+		f.pending.append(data, n);
+		m_nPending += n;
+		
+		if(f.pending.size() >= m_chunkSize) flush(id);
+		
+		if(m_nPending > m_maxPending){
+			for(unsigned int i = 0; i < m_files.size(); ++i) flush(i);
+		}
+	}
+	
+	
+	// writes pending data and closes files, gz files end with empty block
+	
+	void close(){
+		
+		if(m_closed) return;
+		
+		m_closed = true;
+		
+		for(unsigned int i = 0; i < m_files.size(); ++i){
+			
+			if(! hasData(i)) continue;
+			
+			flush(i);
+			
+			std::string eof;
+			
+			if(! BlockCompressor::appendEof(eof, m_cmprsType)){
+				std::cerr << "\nERROR: Compression of output failed.\n" << std::endl;
+				exit(1);
+			}
+			if(eof.size() > 0) writeData(i, eof);
+			
+			closeHandle(i);
+		}
+	}
+};
+
+
+#endif
@@ -11,11 +11,16 @@
 #include <sstream>
 #include <iostream>
 #include <vector>
+#include <chrono>
+#include <atomic>
+#include <mutex>
 
-#include <tbb/pipeline.h>
-#include <tbb/task_scheduler_init.h>
+#include <tbb/parallel_pipeline.h>
+#include <tbb/task_arena.h>
+#include <tbb/global_control.h>
+#include <tbb/info.h>
 #include <tbb/concurrent_vector.h>
-#include <tbb/mutex.h>
+#include <tbb/enumerable_thread_specific.h>
 
 #include <seqan/basic.h>
 #include <seqan/sequence.h>
@@ -33,6 +38,8 @@
 #include "PairedInput.h"
 #include "PairedOutput.h"
 #include "PairedAlign.h"
+#include "StageTimer.h"
+#include "ThreadPinning.h"
 
 
 template <typename TSeqStr, typename TString>
@@ -221,7 +228,7 @@ void printMessage(Options &o){
 }
 
 
-template <typename TSeqStr, typename TString>
+template <typename TSeqStr, typename TString, class TAlgorithm>
 void startProcessing(Options &o){
 	
 	using namespace std;
@@ -236,17 +243,61 @@ void startProcessing(Options &o){
 	
 	if(o.logAlign != NONE) *out << "\n\nAlignment " << o.logAlignStr << " logging:\n\n" << endl;
 	
-	PairedInput<TSeqStr, TString>  inputFilter(o);
-	PairedAlign<TSeqStr, TString>  alignFilter(o);
-	PairedOutput<TSeqStr, TString> outputFilter(o);
+	// bundles and reads are recycled from output to input filter
+	PairedReadPool<TSeqStr, TString> readPool(o);
+	
+	PairedInput<TSeqStr, TString>             inputFilter(o, readPool);
+	PairedInputParser<TSeqStr, TString>       parseFilter(o, inputFilter);
+	PairedAlign<TSeqStr, TString, TAlgorithm> alignFilter(o);
+	PairedOutput<TSeqStr, TString>            outputFilter(o, readPool);
+	PairedOutputFormatter<TSeqStr, TString>   formatFilter(outputFilter);
+	
+	StageTimer inputStage, parseStage, alignStage, formatStage, outputStage;
+	
+	// number of threads may exceed number of cpus
+	tbb::global_control threadLimit(tbb::global_control::max_allowed_parallelism, o.nThreads);
+	
+	// threads of arena are optionally kept on cpus of one numa node
+	tbb::task_arena arena(tbb::task_arena::constraints(o.numaNode, o.nThreads));
+	arena.initialize();
+	
+	ThreadPinObserver *pinObserver = NULL;
+	if(o.pinThreads) pinObserver = new ThreadPinObserver(arena);
+	
+	chrono::steady_clock::time_point runStart = chrono::steady_clock::now();
+	
+	arena.execute([&](){
+		tbb::parallel_pipeline(o.nTokens,
+			
+			tbb::make_filter<void, void*>(inputFilter.getMode(), [&](tbb::flow_control &fc) -> void* {
+				
+				void* item = inputStage.run(inputFilter, NULL);
+				
+				if(item == NULL && inputFilter.isFinished()) fc.stop();
+				return item;
+			}) &
+			
+			tbb::make_filter<void*, void*>(parseFilter.getMode(), [&](void* item) -> void* {
+				return parseStage.run(parseFilter, item);
+			}) &
+			
+			// records are formatted in parallel, output stage only writes buffers
+			tbb::make_filter<void*, void*>(alignFilter.getMode(), [&](void* item) -> void* {
+				return formatStage.run(formatFilter, alignStage.run(alignFilter, item));
+			}) &
+			
+			tbb::make_filter<void*, void>(outputFilter.getMode(), [&](void* item){
+				outputStage.run(outputFilter, item);
+			})
+		);
+		
+		// pending output is written and files are closed
+		outputFilter.finish();
+	});
 	
-	tbb::task_scheduler_init init_serial(o.nThreads);
-	tbb::pipeline pipe;
+	delete pinObserver;
 	
-	pipe.add_filter(inputFilter);
-	pipe.add_filter(alignFilter);
-	pipe.add_filter(outputFilter);
-	pipe.run(o.nThreads);
+	const double runTime = chrono::duration<double>(chrono::steady_clock::now() - runStart).count();
 	
 	if(o.logAlign == TAB) *out << "\n";
 	*out << "done.\n" << endl;
@@ -256,6 +307,21 @@ void startProcessing(Options &o){
 	
 	printComputationTime(o, start, nReads);
 	
+	if(o.pipelineStats){
+		*out << "Pipeline stage times in seconds, " << o.nTokens << " bundles in flight\n";
+		*out << fixed << setprecision(2);
+		*out << "  input    busy " << inputStage.getBusyTime()  << "   run time minus busy " << max(0.0, runTime - inputStage.getBusyTime());
+		
+		if(o.maxMemory > 0) *out << "   memory limit " << readPool.getWaitTime() << " (" << readPool.getNrRetries() << " retries)";
+		
+		*out << "\n";
+		*out << "  parse    busy " << parseStage.getBusyTime() << "\n";
+		*out << "  align    busy " << alignStage.getBusyTime() << "\n";
+		*out << "  format   busy " << formatStage.getBusyTime() << "\n";
+		*out << "  output   busy " << outputStage.getBusyTime() << "   run time minus busy " << max(0.0, runTime - outputStage.getBusyTime());
+		*out << "\n\n" << endl;
+	}
+	
 	
 	// barcode and adapter removal statistics
 	
@@ -273,6 +339,12 @@ void startProcessing(Options &o){
 		}
 	}
 	
+	if(o.seedFilter && (o.barDetect != BOFF || o.adapRm != AOFF))
+		alignFilter.printSeedFilterStats();
+	
+	if(o.barcodeTrie && (o.b_end == LTAIL || o.b_end == RTAIL) && o.barDetect != BOFF)
+		alignFilter.printBarcodeSearchStats();
+	
 	outputFilter.printFileSummary();
 	
 	
@@ -347,6 +419,15 @@ void startProcessing(Options &o){
 }
 
 
+template <typename TSeqStr, typename TString>
+void startProcessing(Options &o){
+	
+	if(o.alignEngine == flexbar::ALIGNMYERS)
+	     startProcessing<TSeqStr, TString, SeqAlignAlgoMyers<TSeqStr> >(o);
+	else startProcessing<TSeqStr, TString, SeqAlignAlgo<TSeqStr> >(o);
+}
+
+
 void performTest(){
 	
 	using namespace std;
@@ -388,6 +469,18 @@ void startComputation(Options &o){
 		#endif
 	}
 	
+	else if(o.cmprsType == ZST){
+		
+		#if FLEXBAR_HAS_ZSTD
+			startProcessing<FSeqStr, FString>(o);
+		#else
+			o.outCompression = "";
+			o.cmprsType = UNCOMPRESSED;
+			cerr << "Output file compression inactive.\n"
+			     << "This build does not support zstd!\n" << endl;
+		#endif
+	}
+	
 	if(o.cmprsType == UNCOMPRESSED){
 		startProcessing<FSeqStr, FString>(o);
 	}
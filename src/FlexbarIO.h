@@ -19,6 +19,10 @@
 #include <bzlib.h>
 #endif
 
+#if FLEXBAR_HAS_ZSTD
+#include "ZstdReader.h"
+#endif
+
 
 void openInputFile(std::fstream &strm, std::string path){
 	using namespace std;
@@ -217,7 +221,7 @@ namespace seqan{
 }
 
 
-void checkFileCompression(const std::string path){
+flexbar::CompressionType checkFileCompression(const std::string path){
 	
 	using namespace std;
 	using namespace flexbar;
@@ -254,8 +258,20 @@ void checkFileCompression(const std::string path){
 					exit(1);
 				#endif
 			}
+			else if(ending == ".zst"){
+				
+				#if FLEXBAR_HAS_ZSTD
+					cmprsType = ZST;
+				#else
+					cerr << "\nInput file decompression canceled.\n";
+					cerr << "This build does not support zstd.\n" << endl;
+					exit(1);
+				#endif
+			}
 		}
 	}
+	
+	return cmprsType;
 }
 
 
@@ -264,7 +280,7 @@ void checkInputType(const std::string path, flexbar::FileFormat &format, const b
 	using namespace std;
 	using namespace flexbar;
 	
-	checkFileCompression(path);
+	const CompressionType cmprsType = checkFileCompression(path);
 	
 	if(path == "-" && isReadsFile){
 		
@@ -284,6 +300,35 @@ void checkInputType(const std::string path, flexbar::FileFormat &format, const b
 			exit(1);
 		}
 	}
+	else if(cmprsType == ZST){
+		
+	#if FLEXBAR_HAS_ZSTD
+		// seqan does not read zst, format is taken from first record
+		ZstdReader reader;
+		string buffer;
+		
+		if(! reader.open(path)){
+			cerr << "\nERROR: Could not open file " << path << "\n" << endl;
+			exit(1);
+		}
+		
+		while(buffer.find_first_not_of(" \t\r\n") == string::npos && reader.read(buffer));
+		
+		const size_t pos = buffer.find_first_not_of(" \t\r\n");
+		
+		if(pos == string::npos){
+			cerr << "\nReads file seems to be empty.\n\n" << endl;
+			exit(1);
+		}
+		
+		     if(buffer[pos] == '>') format = FASTA;
+		else if(buffer[pos] == '@') format = FASTQ;
+		else{
+			cerr << "\nERROR: Format of reads file " << path << " not conform.\n" << endl;
+			exit(1);
+		}
+	#endif
+	}
 	else{
 		seqan::FlexbarReadsSeqFileIn seqFileIn;
 		
@@ -4,32 +4,108 @@
 #define FLEXBAR_FLEXBARTYPES_H
 
 
+// sequence and quality of read are segments of column buffers of its read set
+// in bundle, trims narrow the segments
+
 template <typename TSeqStr, typename TString>
 class SeqRead {
 	
 	public:
-	TSeqStr seq;
-	TString id, qual, umi;
+	typedef typename seqan::Infix<TSeqStr>::Type TSeqSegment;
+	typedef typename seqan::Infix<TString>::Type TStrSegment;
+	
+	TSeqSegment seq;
+	TStrSegment qual;
+	TString id, umi;
 	
 	bool rmAdapter, rmAdapterRC, pairOverlap, poRemoval;
 	
-	SeqRead(TSeqStr& sequence, TString& seqID) :
-		seq(sequence),
-		id(seqID),
+	SeqRead() :
 		rmAdapter(false),
 		rmAdapterRC(false),
 		pairOverlap(false),
 		poRemoval(false){
 	}
 	
-	SeqRead(TSeqStr& sequence, TString& seqID, TString& quality) :
-		seq(sequence),
-		id(seqID),
-		qual(quality),
-		rmAdapter(false),
-		rmAdapterRC(false),
-		pairOverlap(false),
-		poRemoval(false){
+	// reuse of pooled read keeps capacity of strings
+	
+	void set(TSeqStr& sequence, TString& seqID){
+		appendToColumn(seq,  sequence);
+		appendToColumn(qual, TString());
+		
+		id = seqID;
+		seqan::clear(umi);
+		
+		rmAdapter   = false;
+		rmAdapterRC = false;
+		pairOverlap = false;
+		poRemoval   = false;
+	}
+	
+	void set(TSeqStr& sequence, TString& seqID, TString& quality){
+		set(sequence, seqID);
+		appendToColumn(qual, quality);
+	}
+	
+	// removes first n positions, quality is empty for fasta
+	
+	void cutPrefix(const unsigned int n){
+		
+		using namespace seqan;
+		
+		setBeginPosition(seq, beginPosition(seq) + std::min<unsigned int>(n, length(seq)));
+		
+		if(length(qual) > 0)
+		setBeginPosition(qual, beginPosition(qual) + std::min<unsigned int>(n, length(qual)));
+	}
+	
+	// keeps first n positions
+	
+	void keepPrefix(const unsigned int n){
+		
+		using namespace seqan;
+		
+		if(n < length(seq))  setEndPosition(seq,  beginPosition(seq)  + n);
+		if(n < length(qual)) setEndPosition(qual, beginPosition(qual) + n);
+	}
+	
+	// replaces sequence by N in spare position, quality is taken from mate
+	
+	void setToN(const SeqRead &mate){
+		
+		using namespace seqan;
+		
+		const unsigned int pos  = beginPosition(seq);
+		const unsigned int qpos = beginPosition(qual);
+		
+		host(seq)[pos] = 'N';
+		setEndPosition(seq, pos + 1);
+		
+		if(length(mate.qual) > 0){
+			host(qual)[qpos] = mate.qual[0];
+			setEndPosition(qual, qpos + 1);
+		}
+		else setEndPosition(qual, qpos);
+	}
+	
+	private:
+	
+	// appended to column with one spare position for setToN
+	
+	template <typename TSegment, typename TSource>
+	static void appendToColumn(TSegment &segment, const TSource &source){
+		
+		using namespace seqan;
+		
+		typename Host<TSegment>::Type &column = host(segment);
+		
+		const unsigned int pos = length(column);
+		
+		append(column, source);
+		appendValue(column, 'N');
+		
+		setBeginPosition(segment, pos);
+		setEndPosition(segment, pos + length(source));
 	}
 };
 
@@ -50,11 +126,140 @@ class PairedRead {
 		barID(0),
 		barID2(0){
 	}
+};
+
+
+// reads of bundle are kept in one array per read set, paired reads refer to
+// reads at same index, arrays are allocated once for bundle size, sequences
+// and qualities of each read set lie contiguously in one column buffer
+
+template <typename TSeqStr, typename TString>
+class PairedReadBundle {
+	
+	typedef SeqRead<TSeqStr, TString>    TSeqRead;
+	typedef PairedRead<TSeqStr, TString> TPairedRead;
 	
-	virtual ~PairedRead(){
-		delete r1;
-		delete r2;
-		delete b;
+	std::vector<TSeqRead> m_r1, m_r2, m_b;
+	std::vector<TPairedRead> m_pReads;
+	
+	// columns of read sets r1, r2 and b, kept with their capacity
+	TSeqStr m_seqs[3];
+	TString m_quals[3];
+	
+	// formatted records and their compressed blocks by output file, ids of
+	// filled buffers in order
+	std::vector<TString> m_buffers;
+	std::vector<std::string> m_blocks;
+	std::vector<unsigned int> m_bufferIds;
+	
+	unsigned int m_size;
+	unsigned long m_nBytes;
+	
+	public:
+	
+	PairedReadBundle(const unsigned int capacity, const bool isPaired, const bool useBarRead) :
+		m_r1(capacity),
+		m_r2(isPaired   ? capacity : 0),
+		m_b(useBarRead  ? capacity : 0),
+		m_pReads(capacity, TPairedRead(NULL, NULL, NULL)),
+		m_size(0),
+		m_nBytes(0){
+		
+		for(unsigned int i = 0; i < capacity; ++i){
+			               m_pReads[i].r1 = &m_r1[i];
+			if(isPaired)   m_pReads[i].r2 = &m_r2[i];
+			if(useBarRead) m_pReads[i].b  = &m_b[i];
+		}
+		
+		setColumns(m_r1, 0);
+		setColumns(m_r2, 1);
+		setColumns(m_b,  2);
+	}
+	
+	private:
+	
+	void setColumns(std::vector<TSeqRead> &reads, const unsigned int set){
+		
+		for(unsigned int i = 0; i < reads.size(); ++i){
+			seqan::setHost(reads[i].seq,  m_seqs[set]);
+			seqan::setHost(reads[i].qual, m_quals[set]);
+		}
+	}
+	
+	public:
+	
+	// next paired read of bundle, reads are filled by caller
+	
+	TPairedRead* add(){
+		
+		TPairedRead *pRead = &m_pReads[m_size++];
+		
+		pRead->barID  = 0;
+		pRead->barID2 = 0;
+		
+		return pRead;
+	}
+	
+	TPairedRead* at(const unsigned int i){
+		return &m_pReads[i];
+	}
+	
+	unsigned int size() const {
+		return m_size;
+	}
+	
+	unsigned int capacity() const {
+		return m_pReads.size();
+	}
+	
+	// size of input records of bundle
+	
+	unsigned long getNrBytes() const {
+		return m_nBytes;
+	}
+	
+	void setNrBytes(const unsigned long nBytes){
+		m_nBytes = nBytes;
+	}
+	
+	// buffer for records of output file idx, kept with its capacity
+	
+	TString& getBuffer(const unsigned int idx){
+		
+		if(idx >= m_buffers.size()){
+			m_buffers.resize(idx + 1);
+			m_blocks.resize(idx + 1);
+		}
+		
+		if(length(m_buffers[idx]) == 0) m_bufferIds.push_back(idx);
+		
+		return m_buffers[idx];
+	}
+	
+	std::string& getBlocks(const unsigned int idx){
+		return m_blocks[idx];
+	}
+	
+	const std::vector<unsigned int>& getBufferIds() const {
+		return m_bufferIds;
+	}
+	
+	void clear(){
+		
+		for(unsigned int i = 0; i < m_bufferIds.size(); ++i){
+			resize(m_buffers[m_bufferIds[i]], 0);
+			m_blocks[m_bufferIds[i]].clear();
+		}
+		
+		m_bufferIds.clear();
+		
+		for(unsigned int i = 0; i < 3; ++i){
+			resize(m_seqs[i],  0);
+			resize(m_quals[i], 0);
+		}
+		
+		m_size   = 0;
+		m_nBytes = 0;
 	}
 };
 
@@ -93,24 +298,83 @@ namespace flexbar{
 	typedef seqan::StringSet<TAlign>                TAlignSet;
 	typedef seqan::String<int>                      TAlignScores;
 	
+	// read and query of alignment, read or its tail is copied from bundle
+	// column, own copies for extended queries
+	
+	struct AlignCandidate {
+		
+		const FSeqStr *queryPtr;
+		FSeqStr readCopy, queryCopy;
+		
+		AlignCandidate() :
+			queryPtr(NULL){
+		}
+		
+		const FSeqStr& read() const {
+			return readCopy;
+		}
+		
+		const FSeqStr& query() const {
+			return (queryPtr != NULL) ? *queryPtr : queryCopy;
+		}
+	};
+	
 	struct Alignments {
 		TAlignSet aset;
 		TAlignScores ascores;
+		std::vector<AlignCandidate> candidates;
+		
+		// barcode index and mismatches of hash lookup in preload for each read
+		std::vector<std::pair<int, int> > lookups;
+		unsigned int idxLookup;
+		
+		Alignments() :
+			idxLookup(0){
+		}
 	};
 	
 	typedef std::vector<Alignments>    TAlignBundle;
-	typedef std::vector<TPairedRead* > TPairedReadBundle;
+	typedef PairedReadBundle<FSeqStr, FString> TPairedReadBundle;
 	
 	// typedef seqan::StringSet<TAlign, seqan::Dependent<seqan::Tight> > TAlignSet;
 	
 	
-	// struct SeqReadData {
-	// 	TSeqStrs seqs;
-	// 	TStrings ids, quals;
-	// 	TBools uncalled;
-	//
-	// 	SeqReadData(){}
-	// };
+	// reads of one input file, records of mapped or buffered files are kept as
+	// raw range until parsed in parallel, buffered ranges are copied to rawData
+	
+	struct SeqReadData {
+		TSeqStrs seqs;
+		TStrings ids, quals;
+		TBools uncalled;
+		
+		std::string rawData;
+		const char *rawBegin, *rawEnd;
+		unsigned int nReads;
+		
+		SeqReadData() :
+			rawBegin(NULL),
+			rawEnd(NULL),
+			nReads(0){
+		}
+	};
+	
+	struct PairedReadData {
+		SeqReadData *srd, *srd2, *srdBR;
+		unsigned long nBytes;
+		
+		PairedReadData() :
+			srd(new SeqReadData()),
+			srd2(new SeqReadData()),
+			srdBR(new SeqReadData()),
+			nBytes(0){
+		}
+		
+		~PairedReadData(){
+			delete srd;
+			delete srd2;
+			delete srdBR;
+		}
+	};
 	
 	// struct PairedReadBundle {
 	// 	SeqReadData srd, srd2, srdBR;
@@ -126,13 +390,32 @@ namespace flexbar{
 		FSeqStr seq;
 		bool rcAdapter;
 		
-		tbb::atomic<unsigned long> rmOverlap, rmFull;
+		std::atomic<unsigned long> rmOverlap, rmFull;
 		
 		TBar() :
 			rmOverlap(0),
 			rmFull(0),
 			rcAdapter(false){
 	    }
+		
+		// counts are copied by value
+		
+		TBar(const TBar &bar) :
+			id(bar.id),
+			seq(bar.seq),
+			rcAdapter(bar.rcAdapter),
+			rmOverlap(bar.rmOverlap.load()),
+			rmFull(bar.rmFull.load()){
+		}
+		
+		TBar& operator=(const TBar &bar){
+			id        = bar.id;
+			seq       = bar.seq;
+			rcAdapter = bar.rcAdapter;
+			rmOverlap = bar.rmOverlap.load();
+			rmFull    = bar.rmFull.load();
+			return *this;
+		}
 	};
 	
 	
@@ -172,6 +455,12 @@ namespace flexbar{
 		ALIGNRC
 	};
 	
+	enum AlignEngine {
+		ALIGNDP,
+		ALIGNMYERS,
+		ALIGNSEQAN
+	};
+	
 	enum ComputeCycle {
 		PRELOAD,
 		COMPUTE,
@@ -188,7 +477,8 @@ namespace flexbar{
 	enum CompressionType {
 		UNCOMPRESSED,
 		GZ,
-		BZ2
+		BZ2,
+		ZST
 	};
 	
 	enum TrimEnd {
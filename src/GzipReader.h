@@ -0,0 +1,485 @@
+// GzipReader.h
+
+#ifndef FLEXBAR_GZIPREADER_H
+#define FLEXBAR_GZIPREADER_H
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <zlib.h>
+
+#include "ChunkReader.h"
+
+
+// Decompression of gz files ahead of parsing in a background thread. Blocks of
+// bgzf files state their compressed size, so a batch of blocks is read and
+// inflated by the background thread together with helper threads that wait for
+// the next batch. Members of other multi-member files are found by headers in a
+// batch of input and inflated in parallel, candidates are accepted if they
+// follow the previous member. Files with a member larger than a batch are
+// inflated as one stream.
+
+class GzipReader : public ChunkReader {
+
+private:
+	
+	const unsigned int m_nThreads;
+	
+	// batch of bgzf blocks or candidate members, helpers start on new generation
+	bool m_isBgzf;
+	std::string m_input;
+	std::vector<std::string> m_blocks, m_outs;
+	std::vector<size_t> m_starts, m_used;
+	
+	// complete 1, input ended before end of member 0, failed -1
+	std::vector<int> m_state;
+	
+	std::mutex m_mutex;
+	std::condition_variable m_batchReady, m_batchDone;
+	std::atomic<unsigned int> m_next;
+	unsigned long m_generation;
+	unsigned int m_nTasks, m_nBusy;
+	bool m_quit;
+	
+	
+	// size of bgzf block from header, 0 if header is not bgzf
+	
+	static unsigned int getBgzfBlockSize(const unsigned char *h){
+		
+		if(h[0] != 31 || h[1] != 139 || h[2] != 8 || (h[3] & 4) == 0) return 0;
+		
+		const unsigned int xlen = h[10] | (h[11] << 8);
+		
+		if(xlen != 6 || h[12] != 'B' || h[13] != 'C' || h[14] != 2 || h[15] != 0) return 0;
+		
+		return (h[16] | (h[17] << 8)) + 1;
+	}
+	
+	
+	static bool isMemberHeader(const unsigned char *h){
+		
+		return h[0] == 31 && h[1] == 139 && h[2] == 8 && (h[3] & 0xe0) == 0;
+	}
+	
+	
+	static bool inflateBgzfBlock(std::string &out, const std::string &block){
+		
+		const unsigned char *b = reinterpret_cast<const unsigned char*>(block.data());
+		const unsigned int n   = block.size();
+		
+		const unsigned int isize = b[n - 4] | (b[n - 3] << 8) | (b[n - 2] << 16) | (b[n - 1] << 24);
+		const unsigned long crc  = b[n - 8] | (b[n - 7] << 8) | (b[n - 6] << 16) | ((unsigned long) b[n - 5] << 24);
+		
+		out.resize(isize);
+		
+		z_stream zs;
+		zs.zalloc = Z_NULL;
+		zs.zfree  = Z_NULL;
+		zs.opaque = Z_NULL;
+		
+		if(inflateInit2(&zs, -15) != Z_OK) return false;
+		
+		zs.next_in   = const_cast<unsigned char*>(b + 18);
+		zs.avail_in  = n - 26;
+		zs.next_out  = reinterpret_cast<unsigned char*>(&out[0]);
+		zs.avail_out = isize;
+		
+		const int status = isize > 0 ? inflate(&zs, Z_FINISH) : Z_STREAM_END;
+		
+		inflateEnd(&zs);
+		
+		if(status != Z_STREAM_END || zs.avail_out != 0) return false;
+		
+		return crc32(0, reinterpret_cast<const unsigned char*>(out.data()), isize) == crc;
+	}
+	
+	
+	// inflates one member starting at input, sets number of used input bytes
+	
+	static int inflateMember(std::string &out, size_t &used, const unsigned char *in, const size_t size, const size_t sizeHint){
+		
+		out.clear();
+		out.reserve(sizeHint);
+		used = 0;
+		
+		z_stream zs;
+		zs.zalloc   = Z_NULL;
+		zs.zfree    = Z_NULL;
+		zs.opaque   = Z_NULL;
+		zs.avail_in = 0;
+		zs.next_in  = Z_NULL;
+		
+		if(inflateInit2(&zs, 15 + 16) != Z_OK) return -1;
+		
+		zs.next_in  = const_cast<unsigned char*>(in);
+		zs.avail_in = size;
+		
+		int status = Z_OK;
+		
+		while(status == Z_OK){
+			
+			// output grows with member, many members in batch might be small
+			const size_t n = out.size(), step = std::max<size_t>(std::max<size_t>(n, 1 << 12), out.capacity() - n);
+			
+			out.resize(n + step);
+			
+			zs.next_out  = reinterpret_cast<unsigned char*>(&out[n]);
+			zs.avail_out = step;
+			
+			status = inflate(&zs, Z_NO_FLUSH);
+			
+			out.resize(n + step - zs.avail_out);
+		}
+		
+		used = size - zs.avail_in;
+		
+		inflateEnd(&zs);
+		
+		if(status == Z_STREAM_END) return 1;
+		if(status == Z_BUF_ERROR && zs.avail_in == 0) return 0;
+		
+		return -1;
+	}
+	
+	
+	bool readBgzfBlock(std::string &block){
+		
+		unsigned char h[18];
+		
+		if(! m_file.read(reinterpret_cast<char*>(h), 18)){
+			if(m_file.gcount() > 0) m_failed = true;
+			return false;
+		}
+		
+		const unsigned int size = getBgzfBlockSize(h);
+		
+		if(size < 26){
+			m_failed = true;
+			return false;
+		}
+		
+		block.assign(reinterpret_cast<char*>(h), 18);
+		block.resize(size);
+		
+		if(! m_file.read(&block[18], size - 18)){
+			m_failed = true;
+			return false;
+		}
+		return true;
+	}
+	
+	
+	// tasks of batch are claimed by background thread and helpers
+	
+	void inflateTasks(const unsigned int nTasks){
+		
+		unsigned int i;
+		
+		while((i = m_next++) < nTasks){
+			
+			if(m_isBgzf){
+				m_state[i] = inflateBgzfBlock(m_outs[i], m_blocks[i]) ? 1 : -1;
+			}
+			else{
+				const unsigned char *in = reinterpret_cast<const unsigned char*>(m_input.data());
+				
+				// trailer before next candidate states size if member ends there
+				size_t sizeHint = 0;
+				
+				if(i + 1 < nTasks && m_starts[i + 1] >= m_starts[i] + 4){
+					const unsigned char *t = in + m_starts[i + 1] - 4;
+					const size_t isize = t[0] | (t[1] << 8) | (t[2] << 16) | (static_cast<size_t>(t[3]) << 24);
+					
+					sizeHint = std::min<size_t>(isize, 1032 * (m_starts[i + 1] - m_starts[i]));
+				}
+				
+				m_state[i] = inflateMember(m_outs[i], m_used[i], in + m_starts[i], m_input.size() - m_starts[i], sizeHint);
+			}
+		}
+	}
+	
+	
+	void runHelper(){
+		
+		unsigned long generation = 0;
+		
+		while(true){
+			
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_batchReady.wait(lock, [&]{ return m_quit || m_generation != generation; });
+			
+			if(m_quit) return;
+			
+			generation = m_generation;
+			const unsigned int nTasks = m_nTasks;
+			
+			lock.unlock();
+			
+			inflateTasks(nTasks);
+			
+			lock.lock();
+			if(--m_nBusy == 0) m_batchDone.notify_one();
+		}
+	}
+	
+	
+	void inflateBatch(const unsigned int nTasks){
+		
+		if(m_outs.size() < nTasks){
+			m_outs.resize(nTasks);
+			m_used.resize(nTasks);
+			m_state.resize(nTasks);
+		}
+		
+		std::unique_lock<std::mutex> lock(m_mutex);
+		
+		m_nTasks = nTasks;
+		m_nBusy  = m_nThreads - 1;
+		m_next   = 0;
+		++m_generation;
+		
+		lock.unlock();
+		m_batchReady.notify_all();
+		
+		inflateTasks(nTasks);
+		
+		lock.lock();
+		m_batchDone.wait(lock, [&]{ return m_nBusy == 0; });
+	}
+	
+	
+	void inflateBgzf(){
+		
+		const unsigned int batchSize = 64 * m_nThreads;
+		
+		m_blocks.resize(batchSize);
+		
+		while(! m_failed && ! m_stop){
+			
+			unsigned int nBlocks = 0;
+			
+			while(nBlocks < batchSize && readBgzfBlock(m_blocks[nBlocks])) ++nBlocks;
+			
+			if(nBlocks == 0) break;
+			
+			inflateBatch(nBlocks);
+			
+			std::string *chunk = new std::string();
+			
+			for(unsigned int i = 0; i < nBlocks; ++i){
+				if(m_state[i] != 1) m_failed = true;
+				chunk->append(m_outs[i]);
+			}
+			
+			if(m_failed){
+				delete chunk;
+				break;
+			}
+			m_chunks.push(chunk);
+		}
+	}
+	
+	
+	void inflateMembers(){
+		
+		const size_t batchSize = static_cast<size_t>(m_nThreads) << 22;
+		
+		// file offset of first byte in batch
+		std::streamoff offset = 0;
+		
+		while(! m_failed && ! m_stop){
+			
+			// unused bytes of last batch start with next member
+			const size_t kept = m_input.size();
+			
+			m_input.resize(batchSize);
+			m_file.read(&m_input[kept], batchSize - kept);
+			m_input.resize(kept + m_file.gcount());
+			
+			const bool isEnd = m_input.size() < batchSize;
+			
+			if(m_input.empty()) break;
+			
+			const unsigned char *in = reinterpret_cast<const unsigned char*>(m_input.data());
+			const size_t size = m_input.size();
+			
+			m_starts.clear();
+			
+			for(const unsigned char *p = in; p != NULL && p + 4 <= in + size; ){
+				
+				if(isMemberHeader(p)) m_starts.push_back(p - in);
+				
+				p = static_cast<const unsigned char*>(memchr(p + 1, 31, in + size - p - 1));
+			}
+			
+			inflateBatch(m_starts.size());
+			
+			// members are chained from start of batch, large outputs are passed on
+			std::string *chunk = new std::string();
+			size_t pos = 0, j = 0;
+			
+			while(pos < size){
+				
+				while(j < m_starts.size() && m_starts[j] < pos) ++j;
+				
+				if(j == m_starts.size() || m_starts[j] != pos){
+					if(isEnd || size - pos >= 4) m_failed = true;
+					break;
+				}
+				
+				if(m_state[j] != 1){
+					if(m_state[j] < 0 || isEnd) m_failed = true;
+					break;
+				}
+				
+				if(chunk->empty()) chunk->swap(m_outs[j]);
+				else               chunk->append(m_outs[j]);
+				
+				pos += m_used[j];
+				
+				if(chunk->size() >= (1 << 22)){
+					m_chunks.push(chunk);
+					chunk = new std::string();
+				}
+			}
+			
+			if(chunk->size() > 0 && ! m_failed) m_chunks.push(chunk);
+			else                                delete chunk;
+			
+			if(m_failed || isEnd) break;
+			
+			// member exceeds batch
+			if(pos == 0){
+				m_file.clear();
+				m_file.seekg(offset);
+				
+				m_input.clear();
+				inflateStream();
+				break;
+			}
+			
+			m_input.erase(0, pos);
+			offset += pos;
+		}
+	}
+	
+	
+	void inflateStream(){
+		
+		const unsigned int inSize = 1 << 20, outSize = 1 << 22;
+		
+		std::vector<unsigned char> in(inSize);
+		
+		z_stream zs;
+		zs.zalloc   = Z_NULL;
+		zs.zfree    = Z_NULL;
+		zs.opaque   = Z_NULL;
+		zs.avail_in = 0;
+		zs.next_in  = Z_NULL;
+		
+		if(inflateInit2(&zs, 15 + 16) != Z_OK){
+			m_failed = true;
+			return;
+		}
+		
+		int status = Z_OK;
+		
+		while(! m_failed && ! m_stop){
+			
+			if(zs.avail_in == 0){
+				m_file.read(reinterpret_cast<char*>(in.data()), inSize);
+				
+				zs.avail_in = m_file.gcount();
+				zs.next_in  = in.data();
+				
+				if(zs.avail_in == 0){
+					if(status != Z_STREAM_END) m_failed = true;
+					break;
+				}
+			}
+			
+			// next member of multi-member file
+			if(status == Z_STREAM_END) inflateReset(&zs);
+			
+			std::string *chunk = new std::string(outSize, '\0');
+			
+			zs.next_out  = reinterpret_cast<unsigned char*>(&(*chunk)[0]);
+			zs.avail_out = outSize;
+			
+			status = inflate(&zs, Z_NO_FLUSH);
+			
+			if(status != Z_OK && status != Z_STREAM_END && status != Z_BUF_ERROR){
+				delete chunk;
+				m_failed = true;
+				break;
+			}
+			
+			chunk->resize(outSize - zs.avail_out);
+			
+			if(chunk->size() == 0) delete chunk;
+			else                   m_chunks.push(chunk);
+		}
+		
+		inflateEnd(&zs);
+	}
+	
+	
+protected:
+	
+	void run(){
+		
+		unsigned char h[18];
+		
+		m_file.read(reinterpret_cast<char*>(h), 18);
+		
+		const bool isBgzf = m_file.gcount() == 18 && getBgzfBlockSize(h) > 0;
+		
+		m_file.clear();
+		m_file.seekg(0);
+		
+		m_isBgzf = isBgzf;
+		
+		std::vector<std::thread> helpers;
+		
+		for(unsigned int t = 1; t < m_nThreads; ++t)
+			helpers.push_back(std::thread(&GzipReader::runHelper, this));
+		
+		     if(isBgzf)         inflateBgzf();
+		else if(m_nThreads > 1) inflateMembers();
+		else                    inflateStream();
+		
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_quit = true;
+		lock.unlock();
+		
+		m_batchReady.notify_all();
+		
+		for(unsigned int t = 0; t < helpers.size(); ++t) helpers[t].join();
+	}
+	
+public:
+	
+	GzipReader(const unsigned int nThreads) :
+		ChunkReader("gz"),
+		m_nThreads(nThreads > 0 ? nThreads : 1),
+		m_isBgzf(false),
+		m_next(0),
+		m_generation(0),
+		m_nTasks(0),
+		m_nBusy(0),
+		m_quit(false){
+	};
+	
+	
+	virtual ~GzipReader(){
+		stop();
+	};
+};
+
+
+#endif
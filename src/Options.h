@@ -10,6 +10,7 @@
 #include <seqan/arg_parse.h>
 
 #include "FlexbarIO.h"
+#include "ReadStructure.h"
 
 
 struct Options{
@@ -18,17 +19,20 @@ struct Options{
 	std::string outReadsFile, outReadsFile2, outLogFile;
 	std::string barcodeFile, adapterFile, barcode2File, adapter2File;
 	std::string adapterSeq, targetName, logAlignStr, outCompression;
-	std::string htrimLeft, htrimRight;
+	std::string htrimLeft, htrimRight, readStructure, readStructure2;
 	
 	bool isPaired, useAdapterFile, useNumberTag, useRemovalTag, umiTags, logStdout;
 	bool switch2Fasta, writeUnassigned, writeSingleReads, writeSingleReadsP, writeLengthDist;
 	bool useStdin, useStdout, relaxRegion, useRcTrimEnd, qtrimPostRm, addBarcodeAdapter;
-	bool interleavedInput, iupacInput, htrimAdapterRm, htrimMaxFirstOnly;
+	bool interleavedInput, iupacInput, htrimAdapterRm, htrimMaxFirstOnly, bandedAlign;
+	bool seedFilter, ungappedAlign, barcodeHash, barcodeTrie, pipelineStats;
+	bool pinThreads, unorderedOutput;
 	
 	int cutLen_begin, cutLen_end, cutLen_read, a_tail_len, b_tail_len, p_min_overlap;
 	int qtrimThresh, qtrimWinSize, a_overhang, htrimMinLength, htrimMinLength2, htrimMaxLength;
 	int maxUncalled, min_readLen, a_min_overlap, b_min_overlap, nThreads, bundleSize, nBundles;
-	int a_match, a_mismatch, a_gapCost, b_match, b_mismatch, b_gapCost, a_cycles;
+	int a_match, a_mismatch, a_gapCost, b_match, b_mismatch, b_gapCost, a_cycles, gzipThreads;
+	int nTokens, maxMemory, numaNode, zipLevel, maxOpenFiles;
 	
 	float a_errorRate, b_errorRate, h_errorRate;
 	
@@ -45,6 +49,7 @@ struct Options{
 	flexbar::PairOverlap     poMode;
 	flexbar::AdapterPreset   aPreset;
 	flexbar::AdapterTrimmed  aTrimmed;
+	flexbar::AlignEngine     alignEngine;
 	
 	tbb::concurrent_vector<flexbar::TBar> barcodes, adapters, barcodes2, adapters2;
 	
@@ -68,6 +73,8 @@ struct Options{
 		outCompression = "";
 		htrimLeft      = "";
 		htrimRight     = "";
+		readStructure  = "";
+		readStructure2 = "";
 		
 		isPaired          = false;
 		useAdapterFile    = false;
@@ -90,6 +97,14 @@ struct Options{
 		qtrimPostRm       = false;
 		htrimAdapterRm    = false;
 		htrimMaxFirstOnly = false;
+		bandedAlign       = false;
+		seedFilter        = false;
+		ungappedAlign     = false;
+		barcodeHash       = false;
+		barcodeTrie       = false;
+		pipelineStats     = false;
+		pinThreads        = false;
+		unorderedOutput   = false;
 		
 		cutLen_begin    = 0;
 		cutLen_end      = 0;
@@ -103,6 +118,12 @@ struct Options{
 		htrimMinLength2 = 0;
 		htrimMaxLength  = 0;
 		nBundles        = 0;
+		gzipThreads     = 1;
+		nTokens         = 0;
+		maxMemory       = 0;
+		numaNode        = -1;
+		zipLevel        = 0;
+		maxOpenFiles    = 64;
 		
 		format    = FASTA;
 		qual      = SANGER;
@@ -118,6 +139,7 @@ struct Options{
 		b_end     = LTAIL;
 		aPreset   = APOFF;
 		aTrimmed  = ATON;
+		alignEngine = ALIGNDP;
     }
 };
 
@@ -184,11 +206,20 @@ void defineOptions(seqan::ArgumentParser &parser, const std::string version, con
 	addOption(parser, ArgParseOption("n", "threads", "Number of threads to employ.", ARG::INTEGER));
 	addOption(parser, ArgParseOption("N", "bundle", "Number of (paired) reads per thread.", ARG::INTEGER));
 	addOption(parser, ArgParseOption("M", "bundles", "Process only certain number of bundles for testing.", ARG::INTEGER));
+	addOption(parser, ArgParseOption("T", "tokens", "Number of bundles in flight. Default: number of threads.", ARG::INTEGER));
+	addOption(parser, ArgParseOption("mm", "max-memory", "Limit in MB for reads in flight and for pending barcoded output.", ARG::INTEGER));
+	addOption(parser, ArgParseOption("ps", "pipeline-stats", "Print busy time of pipeline stages, rest of run time for serial ones."));
+	addOption(parser, ArgParseOption("nn", "numa-node", "Run threads on cpus of numa node, requires tbbbind.", ARG::INTEGER));
+	addOption(parser, ArgParseOption("pt", "pin-threads", "Pin each thread to one cpu."));
+	addOption(parser, ArgParseOption("uo", "unordered-output", "Write bundles when finished, order of reads may change."));
+	addOption(parser, ArgParseOption("A", "align-engine", "Alignment algorithm for barcodes and adapters.", ARG::STRING));
+	addOption(parser, ArgParseOption("F", "seed-filter", "Skip alignments ruled out by k-mer seeds and read end check."));
 	addOption(parser, ArgParseOption("t", "target", "Prefix for output file names or paths.", ARG::OUTPUT_PREFIX));
 	addOption(parser, ArgParseOption("r", "reads", "Fasta/q file or stdin (-) with reads that may contain barcodes.", ARG::INPUT_FILE));
-	addOption(parser, ArgParseOption("p", "reads2", "Second input file of paired reads, gz and bz2 files supported.", ARG::INPUT_FILE));
+	addOption(parser, ArgParseOption("p", "reads2", "Second input file of paired reads, gz, bz2 and zst files supported.", ARG::INPUT_FILE));
 	addOption(parser, ArgParseOption("i", "interleaved", "Interleaved format for first input set with paired reads."));
 	addOption(parser, ArgParseOption("I", "iupac", "Accept iupac symbols in reads and convert to N if not ATCG."));
+	addOption(parser, ArgParseOption("gt", "gzip-threads", "Threads for decompression of gz reads files ahead of parsing.", ARG::INTEGER));
 	
 	addSection(parser, "Barcode detection");
 	addOption(parser, ArgParseOption("b",  "barcodes", "Fasta file with barcodes for demultiplexing, may contain N.", ARG::INPUT_FILE));
@@ -200,6 +231,11 @@ void defineOptions(seqan::ArgumentParser &parser, const std::string version, con
 	addOption(parser, ArgParseOption("bn", "barcode-tail-length", "Region size in tail trim-end modes. Default: barcode length.", ARG::INTEGER));
 	addOption(parser, ArgParseOption("bk", "barcode-keep", "Keep barcodes within reads instead of removal."));
 	addOption(parser, ArgParseOption("bu", "barcode-unassigned", "Include unassigned reads in output generation."));
+	addOption(parser, ArgParseOption("bh", "barcode-hash", "Look up barcodes at tail by mismatches before alignment."));
+	addOption(parser, ArgParseOption("bx", "barcode-trie", "Align only barcodes found in trie by edit distance to tail."));
+	addOption(parser, ArgParseOption("bf", "barcode-open-files", "Maximum of output files kept open, files are written lazily.", ARG::INTEGER));
+	addOption(parser, ArgParseOption("rs", "read-structure", "Cut barcode, UMI and template by offset, e.g. 8B12M+T.", ARG::STRING));
+	addOption(parser, ArgParseOption("rs2", "read-structure2", "Read structure for second read set in paired mode.", ARG::STRING));
 	addOption(parser, ArgParseOption("bm", "barcode-match", "Alignment match score.", ARG::INTEGER));
 	addOption(parser, ArgParseOption("bi", "barcode-mismatch", "Alignment mismatch score.", ARG::INTEGER));
 	addOption(parser, ArgParseOption("bg", "barcode-gap", "Alignment gap score.", ARG::INTEGER));
@@ -215,6 +251,8 @@ void defineOptions(seqan::ArgumentParser &parser, const std::string version, con
 	addOption(parser, ArgParseOption("an", "adapter-tail-length", "Region size for tail trim-end modes. Default: adapter length.", ARG::INTEGER));
 	// addOption(parser, ArgParseOption("ah", "adapter-overhang", "Overhang at read ends in right and left modes.", ARG::INTEGER));
 	addOption(parser, ArgParseOption("ax", "adapter-relaxed", "Skip restriction to pass read ends in right and left modes."));
+	addOption(parser, ArgParseOption("aw", "adapter-band", "Align only diagonals allowed by min-overlap and error rate."));
+	addOption(parser, ArgParseOption("au", "adapter-ungapped", "Align with gaps only if best ungapped overlap is not unique and valid."));
 	addOption(parser, ArgParseOption("ap", "adapter-pair-overlap", "Overlap detection of paired reads.", ARG::STRING));
 	addOption(parser, ArgParseOption("av", "adapter-min-poverlap", "Minimum overlap of paired reads for detection.", ARG::INTEGER));
 	addOption(parser, ArgParseOption("ac", "adapter-revcomp", "Include reverse complements of adapters.", ARG::STRING));
@@ -262,6 +300,7 @@ void defineOptions(seqan::ArgumentParser &parser, const std::string version, con
 	addSection(parser, "Output selection");
 	addOption(parser, ArgParseOption("f", "fasta-output", "Prefer non-quality format fasta for output."));
 	addOption(parser, ArgParseOption("z", "zip-output", "Direct compression of output files.", ARG::STRING));
+	addOption(parser, ArgParseOption("zl", "zip-level", "Compression level, gz and bz2 up to 9, zst up to 19.", ARG::INTEGER));
 	addOption(parser, ArgParseOption("1", "stdout-reads", "Write reads to stdout, tagged and interleaved if needed."));
 	addOption(parser, ArgParseOption("R", "output-reads", "Output file for reads instead of target prefix usage.", ARG::OUTPUT_FILE));
 	addOption(parser, ArgParseOption("P", "output-reads2", "Output file for reads2 instead of target prefix usage.", ARG::OUTPUT_FILE));
@@ -284,6 +323,11 @@ void defineOptions(seqan::ArgumentParser &parser, const std::string version, con
 	setAdvanced(parser, "barcode-tail-length");
 	setAdvanced(parser, "barcode-keep");
 	setAdvanced(parser, "barcode-unassigned");
+	setAdvanced(parser, "barcode-hash");
+	setAdvanced(parser, "barcode-trie");
+	setAdvanced(parser, "barcode-open-files");
+	setAdvanced(parser, "read-structure");
+	setAdvanced(parser, "read-structure2");
 	setAdvanced(parser, "barcode-match");
 	setAdvanced(parser, "barcode-mismatch");
 	setAdvanced(parser, "barcode-gap");
@@ -291,6 +335,8 @@ void defineOptions(seqan::ArgumentParser &parser, const std::string version, con
 	setAdvanced(parser, "adapter-seq");
 	setAdvanced(parser, "adapter-tail-length");
 	setAdvanced(parser, "adapter-relaxed");
+	setAdvanced(parser, "adapter-band");
+	setAdvanced(parser, "adapter-ungapped");
 	setAdvanced(parser, "adapter-min-poverlap");
 	setAdvanced(parser, "adapter-revcomp");
 	setAdvanced(parser, "adapter-revcomp-end");
@@ -316,8 +362,18 @@ void defineOptions(seqan::ArgumentParser &parser, const std::string version, con
 	setAdvanced(parser, "man-help");
 	setAdvanced(parser, "bundle");
 	setAdvanced(parser, "bundles");
+	setAdvanced(parser, "tokens");
+	setAdvanced(parser, "max-memory");
+	setAdvanced(parser, "pipeline-stats");
+	setAdvanced(parser, "numa-node");
+	setAdvanced(parser, "pin-threads");
+	setAdvanced(parser, "unordered-output");
+	setAdvanced(parser, "align-engine");
+	setAdvanced(parser, "seed-filter");
 	setAdvanced(parser, "interleaved");
 	setAdvanced(parser, "iupac");
+	setAdvanced(parser, "gzip-threads");
+	setAdvanced(parser, "zip-level");
 	setAdvanced(parser, "length-dist");
 	setAdvanced(parser, "single-reads");
 	setAdvanced(parser, "single-reads-paired");
@@ -365,7 +421,8 @@ void defineOptions(seqan::ArgumentParser &parser, const std::string version, con
 	setValidValues(parser, "qtrim", "TAIL WIN BWA");
 	setValidValues(parser, "qtrim-format", "sanger solexa i1.3 i1.5 i1.8");
 	setValidValues(parser, "align-log", "ALL MOD TAB");
-	setValidValues(parser, "zip-output", "GZ BZ2");
+	setValidValues(parser, "zip-output", "GZ BZ2 ZST");
+	setValidValues(parser, "align-engine", "DP MYERS SEQAN");
 	
 	setValidValues(parser, "adapter-read-set", "1 2");
 	setValidValues(parser, "adapter-revcomp", "ON ONLY");
@@ -377,6 +434,7 @@ void defineOptions(seqan::ArgumentParser &parser, const std::string version, con
 	setDefaultValue(parser, "target",  "flexbarOut");
 	setDefaultValue(parser, "threads", "1");
 	setDefaultValue(parser, "bundle",  "256");
+	setDefaultValue(parser, "align-engine", "DP");
 	
 	setDefaultValue(parser, "max-uncalled",         "0");
 	setDefaultValue(parser, "min-read-length",      "18");
@@ -564,6 +622,69 @@ void loadOptions(Options &o, seqan::ArgumentParser &parser){
 		exit(1);
 	}
 	
+	o.nTokens = o.nThreads;
+	
+	if(isSet(parser, "tokens")){
+		getOptionValue(o.nTokens, parser, "tokens");
+		*out << "Bundles in flight:     " << o.nTokens << endl;
+		
+		if(o.nTokens < 1){
+			cerr << "\n" << "Number of bundles in flight should be 1 at least.\n" << endl;
+			exit(1);
+		}
+	}
+	
+	if(isSet(parser, "max-memory")){
+		getOptionValue(o.maxMemory, parser, "max-memory");
+		*out << "Memory of bundles:     " << o.maxMemory << " MB" << endl;
+		
+		if(o.maxMemory < 1){
+			cerr << "\n" << "Memory limit should be 1 MB at least.\n" << endl;
+			exit(1);
+		}
+	}
+	
+	if(isSet(parser, "pipeline-stats")){
+		*out << "Pipeline stats:        on" << endl;
+		o.pipelineStats = true;
+	}
+	
+	if(isSet(parser, "numa-node")){
+		getOptionValue(o.numaNode, parser, "numa-node");
+		*out << "Numa node:             " << o.numaNode << endl;
+		
+		vector<tbb::numa_node_id> nodes = tbb::info::numa_nodes();
+		
+		if(o.numaNode < 0 || std::find(nodes.begin(), nodes.end(), o.numaNode) == nodes.end()){
+			cerr << "\n" << "Numa node not available, tbbbind and hwloc are required.\n" << endl;
+			exit(1);
+		}
+	}
+	
+	if(isSet(parser, "pin-threads")){
+		*out << "Pinned threads:        on" << endl;
+		o.pinThreads = true;
+	}
+	
+	if(isSet(parser, "unordered-output")){
+		*out << "Unordered output:      on" << endl;
+		o.unorderedOutput = true;
+	}
+	
+	if(isSet(parser, "align-engine")){
+		string alignEngine;
+		getOptionValue(alignEngine, parser, "align-engine");
+		*out << "Alignment engine:      " << alignEngine << endl;
+		
+		     if(alignEngine == "MYERS") o.alignEngine = ALIGNMYERS;
+		else if(alignEngine == "SEQAN") o.alignEngine = ALIGNSEQAN;
+	}
+	
+	if(isSet(parser, "seed-filter")){
+		*out << "Seed filter:           on" << endl;
+		o.seedFilter = true;
+	}
+	
 	if(isSet(parser, "bundles")){
 		getOptionValue(o.nBundles, parser, "bundles");
 		*out << "Number of bundles:     " << o.nBundles << endl << endl;
@@ -629,6 +750,16 @@ void loadOptions(Options &o, seqan::ArgumentParser &parser){
 		o.iupacInput = true;
 	}
 	
+	if(isSet(parser, "gzip-threads")){
+		getOptionValue(o.gzipThreads, parser, "gzip-threads");
+		*out << "Gzip threads:          " << o.gzipThreads << endl;
+		
+		if(o.gzipThreads < 1){
+			cerr << "\n" << "Number of gzip threads should be positive.\n" << endl;
+			exit(1);
+		}
+	}
+	
 	
 	// barcode and adapter file options
 	
@@ -874,6 +1005,21 @@ void loadOptions(Options &o, seqan::ArgumentParser &parser){
 			o.cmprsType = BZ2;
 			o.outCompression = ".bz2";
 		}
+		else if(o.outCompression == "ZST"){
+			o.cmprsType = ZST;
+			o.outCompression = ".zst";
+		}
+	}
+	
+	if(isSet(parser, "zip-level")){
+		getOptionValue(o.zipLevel, parser, "zip-level");
+		
+		const int maxLevel = (o.cmprsType == ZST) ? 19 : 9;
+		
+		if(o.zipLevel < 1 || o.zipLevel > maxLevel){
+			cerr << "\n" << "Zip level should be between 1 and " << maxLevel << ".\n" << endl;
+			exit(1);
+		}
 	}
 	
 	if(isSet(parser, "single-reads")) o.writeSingleReads = true;
@@ -957,6 +1103,26 @@ void loadOptions(Options &o, seqan::ArgumentParser &parser){
 		
 		if(isSet(parser, "barcode-unassigned")) o.writeUnassigned = true;
 		
+		if(isSet(parser, "barcode-hash")){
+			*out << "barcode-hash:          on" << endl;
+			o.barcodeHash = true;
+		}
+		
+		if(isSet(parser, "barcode-trie")){
+			*out << "barcode-trie:          on" << endl;
+			o.barcodeTrie = true;
+		}
+		
+		if(isSet(parser, "barcode-open-files")){
+			getOptionValue(o.maxOpenFiles, parser, "barcode-open-files");
+			*out << "barcode-open-files:    " << o.maxOpenFiles << endl;
+			
+			if(o.maxOpenFiles < 1){
+				cerr << "\nNumber of open barcode files should be 1 at least.\n" << endl;
+				exit(1);
+			}
+		}
+		
 		getOptionValue(o.b_match,    parser, "barcode-match");
 		getOptionValue(o.b_mismatch, parser, "barcode-mismatch");
 		getOptionValue(o.b_gapCost,  parser, "barcode-gap");
@@ -975,6 +1141,60 @@ void loadOptions(Options &o, seqan::ArgumentParser &parser){
 	}
 	
 	
+	// read structure options
+	
+	if(isSet(parser, "read-structure") || (o.isPaired && isSet(parser, "read-structure2"))){
+		
+		ReadStructure rs, rs2;
+		
+		if(isSet(parser, "read-structure")){
+			getOptionValue(o.readStructure, parser, "read-structure");
+			*out << "read-structure:        " << o.readStructure << endl;
+			
+			if(! rs.parse(o.readStructure)){
+				cerr << "\nSpecified read structure is invalid.\n" << endl;
+				exit(1);
+			}
+		}
+		
+		if(o.isPaired && isSet(parser, "read-structure2")){
+			getOptionValue(o.readStructure2, parser, "read-structure2");
+			*out << "read-structure2:       " << o.readStructure2 << endl;
+			
+			if(! rs2.parse(o.readStructure2)){
+				cerr << "\nSpecified read structure 2 is invalid.\n" << endl;
+				exit(1);
+			}
+		}
+		
+		bool twoBarcodes = o.barDetect == WITHIN_READ_REMOVAL2 || o.barDetect == WITHIN_READ2;
+		
+		if(o.barDetect == BARCODE_READ){
+			cerr << "\nRead structure can not be used with separate barcode reads.\n" << endl;
+			exit(1);
+		}
+		
+		if((o.barDetect != BOFF && ! rs.hasSegment('B')) || (twoBarcodes && ! rs2.hasSegment('B'))){
+			cerr << "\nBarcode detection by read structure needs barcode segment.\n" << endl;
+			exit(1);
+		}
+		
+		if((o.barDetect == BOFF && rs.hasSegment('B')) || (! twoBarcodes && rs2.hasSegment('B'))){
+			cerr << "\nBarcode segment of read structure needs barcodes file.\n" << endl;
+			exit(1);
+		}
+		
+		if(rs.getLength('B') < 0 || rs2.getLength('B') < 0){
+			cerr << "\nBarcode segment of read structure should have fixed length.\n" << endl;
+			exit(1);
+		}
+		
+		if(rs.hasSegment('M') || rs2.hasSegment('M')) o.umiTags = true;
+		
+		*out << endl;
+	}
+	
+	
 	// adapter options
 	
 	if(o.isPaired && isSet(parser, "adapter-pair-overlap")){
@@ -1057,6 +1277,16 @@ void loadOptions(Options &o, seqan::ArgumentParser &parser){
 				o.relaxRegion = true;
 			}
 			
+			if(isSet(parser, "adapter-band")){
+				*out << "adapter-band:          on" << endl;
+				o.bandedAlign = true;
+			}
+			
+			if(isSet(parser, "adapter-ungapped")){
+				*out << "adapter-ungapped:      on" << endl;
+				o.ungappedAlign = true;
+			}
+			
 			if(isSet(parser, "adapter-add-barcode") && o.isPaired && o.a_end == RIGHT && o.rcMode != RCON &&
 				o.barDetect != BARCODE_READ && o.barDetect != BOFF && o.b_end == LTAIL){
 				
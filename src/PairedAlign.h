@@ -6,15 +6,16 @@
 #include "SeqAlign.h"
 #include "SeqAlignPair.h"
 #include "SeqAlignAlgo.h"
+#include "SeqAlignAlgoMyers.h"
 
 
-template <typename TSeqStr, typename TString>
-class PairedAlign : public tbb::filter {
+template <typename TSeqStr, typename TString, class TAlgorithm>
+class PairedAlign {
 
 private:
 	
 	const bool m_writeUnassigned, m_twoBarcodes, m_umiTags, m_useRcTrimEnd;
-	const bool m_htrim, m_htrimAdapterRm, m_htrimMaxFirstOnly, m_addBarcodeAdapter;
+	const bool m_htrim, m_htrimAdapterRm, m_htrimMaxFirstOnly, m_addBarcodeAdapter, m_useReadStructure;
 	
 	const std::string m_htrimLeft, m_htrimRight;
 	
@@ -31,23 +32,25 @@ private:
 	const flexbar::TrimEnd        m_aTrimEnd, m_arcTrimEnd, m_bTrimEnd;
 	const flexbar::PairOverlap    m_poMode;
 	
-	tbb::atomic<unsigned long> m_unassigned;
+	std::atomic<unsigned long> m_unassigned;
 	tbb::concurrent_vector<flexbar::TBar> *m_adapters, *m_adapters2;
 	tbb::concurrent_vector<flexbar::TBar> *m_barcodes, *m_barcodes2;
 	
-	typedef SeqAlign<TSeqStr, TString, SeqAlignAlgo<TSeqStr> > TSeqAlign;
+	typedef SeqAlign<TSeqStr, TString, TAlgorithm> TSeqAlign;
 	TSeqAlign *m_a1, *m_b1, *m_a2, *m_b2;
 	
 	typedef SeqAlignPair<TSeqStr, TString, SeqAlignAlgo<TSeqStr> > TSeqAlignPair;
 	TSeqAlignPair *m_p;
 	
+	ReadStructure m_rs1, m_rs2;
+	BarcodeHash m_barcodeHash1, m_barcodeHash2;
+	
 	std::ostream *out;
 	
 public:
 	
 	PairedAlign(Options &o) :
 		
-		filter(parallel),
 		m_format(o.format),
 		m_log(o.logAlign),
 		m_runType(o.runType),
@@ -72,6 +75,7 @@ public:
 		m_htrimAdapterRm(o.htrimAdapterRm),
 		m_htrim(o.htrimLeft != "" || o.htrimRight != ""),
 		m_twoBarcodes(o.barDetect == flexbar::WITHIN_READ_REMOVAL2 || o.barDetect == flexbar::WITHIN_READ2),
+		m_useReadStructure(o.readStructure != "" || o.readStructure2 != ""),
 		out(o.out),
 		m_unassigned(0){
 		
@@ -88,6 +92,14 @@ public:
 		
 		m_p  = new TSeqAlignPair(o, o.p_min_overlap, o.a_errorRate, o.a_match, o.a_mismatch, o.a_gapCost);
 		
+		if(m_useReadStructure){
+			m_rs1.parse(o.readStructure);
+			m_rs2.parse(o.readStructure2);
+			
+			if(m_rs1.hasSegment('B')) buildBarcodeHash(m_barcodeHash1, m_barcodes,  m_rs1.getLength('B'), o.b_errorRate);
+			if(m_rs2.hasSegment('B')) buildBarcodeHash(m_barcodeHash2, m_barcodes2, m_rs2.getLength('B'), o.b_errorRate);
+		}
+		
 		if(m_log == flexbar::TAB)
 		*out << "ReadTag\tQueryTag\tQueryStart\tQueryEnd\tOverlapLength\tMismatches\tIndels\tAllowedErrors" << std::endl;
 	}
@@ -102,6 +114,69 @@ public:
 	};
 	
 	
+	// barcodes of read structure are looked up by mismatches within error rate
+	
+	void buildBarcodeHash(BarcodeHash &hash, tbb::concurrent_vector<flexbar::TBar> *barcodes, const int len, const float errorRate){
+		
+		using namespace std;
+		
+		vector<int16_t> codes;
+		
+		for(unsigned int i = 0; i < barcodes->size(); ++i){
+			SeqAlignAlgo<TSeqStr>::assignCodes(codes, barcodes->at(i).seq);
+			hash.addBarcode(codes);
+		}
+		
+		int maxMismatches = 0;
+		while(static_cast<float>(maxMismatches + 1) <= errorRate * len) ++maxMismatches;
+		
+		if(! hash.build(maxMismatches) || hash.getLength() != len){
+			cerr << "\nBarcodes should have length of read structure barcode segment without N, at most 32.\n" << endl;
+			exit(1);
+		}
+	}
+	
+	
+	unsigned int cutReadStructure(flexbar::TSeqRead* seqRead, const ReadStructure &rs, const BarcodeHash &hash){
+		
+		using namespace flexbar;
+		
+		FSeqStr barcode, umi;
+		
+		const bool keepBarcode = m_barType == WITHIN_READ || m_barType == WITHIN_READ2;
+		
+		rs.cut(seqRead, barcode, umi, keepBarcode, m_format == FASTQ);
+		
+		if(length(umi) > 0){
+			append(seqRead->umi, "_");
+			append(seqRead->umi, umi);
+		}
+		
+		if(length(barcode) == 0) return 0;
+		
+		std::vector<int16_t> codes;
+		SeqAlignAlgo<TSeqStr>::assignCodes(codes, barcode);
+		
+		int index, mismatches;
+		
+		if(hash.lookup(index, mismatches, codes.data(), codes.size())) return index + 1;
+		
+		return 0;
+	}
+	
+	
+	void cutPairedReadStructure(flexbar::TPairedRead* pRead){
+		
+		if(! m_rs1.empty())
+		pRead->barID = cutReadStructure(pRead->r1, m_rs1, m_barcodeHash1);
+		
+		if(pRead->r2 != NULL && ! m_rs2.empty())
+		pRead->barID2 = cutReadStructure(pRead->r2, m_rs2, m_barcodeHash2);
+		
+		if(m_barType != flexbar::BOFF && (pRead->barID == 0 || (m_twoBarcodes && pRead->barID2 == 0))) m_unassigned++;
+	}
+	
+	
 	void alignPairedReadToBarcodes(flexbar::TPairedRead* pRead, flexbar::TAlignBundle &alBundle, std::vector<flexbar::ComputeCycle> &cycle, std::vector<unsigned int> &idxAl, const flexbar::AlignmentMode &alMode){
 		
 		using namespace flexbar;
@@ -212,11 +287,7 @@ public:
 				if(m_htrimMinLength2 > 0 && s > 0) htrimMinLength = m_htrimMinLength2;
 				
 				if(cutPos > 0 && cutPos >= htrimMinLength){
-					erase(seqRead->seq, 0, cutPos);
-					
-					if(m_format == FASTQ){
-						erase(seqRead->qual, 0, cutPos);
-					}
+					seqRead->cutPrefix(cutPos);
 				}
 			}
 		}
@@ -263,17 +334,19 @@ public:
 				if(m_htrimMinLength2 > 0 && s > 0) htrimMinLength = m_htrimMinLength2;
 				
 				if(cutPos < seqLen && cutPos <= seqLen - htrimMinLength){
-					erase(seqRead->seq, cutPos, length(seqRead->seq));
-					
-					if(m_format == FASTQ){
-						erase(seqRead->qual, cutPos, length(seqRead->qual));
-					}
+					seqRead->keepPrefix(cutPos);
 				}
 			}
 		}
 	}
 	
 	
+	// mode of pipeline stage
+	tbb::filter_mode getMode() const {
+		return tbb::filter_mode::parallel;
+	}
+	
+	
 	// tbb filter operator
 	void* operator()(void* item){
 		
@@ -283,20 +356,21 @@ public:
 			
 			TPairedReadBundle *prBundle = static_cast<TPairedReadBundle* >(item);
 			
-			if(m_umiTags){
+			// umi of reads is cleared by input
+			
+			AlignmentMode alMode = ALIGNALL;
+			
+			// fixed positions of read structure
+			
+			if(m_useReadStructure){
 				for(unsigned int i = 0; i < prBundle->size(); ++i){
-					prBundle->at(i)->r1->umi = "";
-					
-					if(prBundle->at(i)->r2 != NULL)
-					prBundle->at(i)->r2->umi = "";
+					cutPairedReadStructure(prBundle->at(i));
 				}
 			}
 			
-			AlignmentMode alMode = ALIGNALL;
-			
 			// barcode detection
 			
-			if(m_barType != BOFF){
+			if(m_barType != BOFF && ! m_useReadStructure){
 				
 				TAlignBundle alBundle;
 				Alignments r1AlignmentsB, r2AlignmentsB, bAlignmentsB;
@@ -478,6 +552,23 @@ public:
 		*out << std::endl;
 	}
 	
+	
+	void printSeedFilterStats(){
+		
+		unsigned long nAlignments = m_b1->getNrAlignments() + m_b2->getNrAlignments() + m_a1->getNrAlignments() + m_a2->getNrAlignments();
+		unsigned long nSkipped    = m_b1->getNrSkippedAlignments() + m_b2->getNrSkippedAlignments() + m_a1->getNrSkippedAlignments() + m_a2->getNrSkippedAlignments();
+		
+		*out << "Seed filter skipped " << nSkipped << " of " << nAlignments << " alignments\n\n" << std::endl;
+	}
+	
+	
+	void printBarcodeSearchStats(){
+		
+		unsigned long nAmbiguous = m_b1->getNrAmbiguousReads() + m_b2->getNrAmbiguousReads();
+		
+		*out << "Barcode search found " << nAmbiguous << " reads with tie of nearest barcodes\n\n" << std::endl;
+	}
+	
 };
 
 #endif
@@ -4,10 +4,11 @@
 #define FLEXBAR_PAIREDINPUT_H
 
 #include "SeqInput.h"
+#include "PairedReadPool.h"
 
 
 template <typename TSeqStr, typename TString>
-class PairedInput : public tbb::filter {
+class PairedInput {
 
 private:
 	
@@ -15,14 +16,30 @@ private:
 	const bool m_isPaired, m_useBarRead, m_useNumberTag, m_interleaved;
 	const unsigned int m_bundleSize;
 	
-	tbb::atomic<unsigned long> m_uncalled, m_uncalledPairs, m_tagCounter, m_nBundles;
+	std::atomic<unsigned long> m_uncalled, m_uncalledPairs, m_tagCounter, m_nBundles;
 	SeqInput<TSeqStr, TString> *m_f1, *m_f2, *m_b;
 	
+	PairedReadPool<TSeqStr, TString> &m_pool;
+	
+	// records not yet admitted by memory limit
+	flexbar::PairedReadData *m_pending;
+	bool m_finished;
+	
+	
+	static unsigned long getNrBytes(const flexbar::SeqReadData &srd){
+		
+		using namespace seqan;
+		
+		if(srd.rawBegin != NULL) return srd.rawEnd - srd.rawBegin;
+		
+		return lengthSum(srd.ids) + lengthSum(srd.seqs) + lengthSum(srd.quals);
+	}
+	
 public:
 	
-	PairedInput(const Options &o) :
+	PairedInput(const Options &o, PairedReadPool<TSeqStr, TString> &pool) :
 		
-		filter(serial_in_order),
+		m_pool(pool),
 		m_format(o.format),
 		m_useNumberTag(o.useNumberTag),
 		m_interleaved(o.interleavedInput),
@@ -32,7 +49,9 @@ public:
 		m_nBundles(o.nBundles),
 		m_tagCounter(0),
 		m_uncalled(0),
-		m_uncalledPairs(0){
+		m_uncalledPairs(0),
+		m_pending(NULL),
+		m_finished(false){
 		
 		m_f1 = new SeqInput<TSeqStr, TString>(o, o.readsFile, true, o.useStdin);
 		
@@ -46,33 +65,63 @@ public:
 		m_b = new SeqInput<TSeqStr, TString>(o, o.barReadsFile, false, false);
 		
 		if(m_nBundles > 0) ++m_nBundles;
+		
+		// files of paired or barcode reads are read concurrently
+		if(m_f2 != NULL || m_b != NULL){
+			
+			unsigned int bundleSize      = m_bundleSize;
+			if(m_interleaved) bundleSize = m_bundleSize * 2;
+			
+			                 m_f1->startReadAhead(bundleSize);
+			if(m_f2 != NULL) m_f2->startReadAhead(m_bundleSize);
+			if(m_b  != NULL) m_b->startReadAhead(m_bundleSize);
+		}
 	}
 	
 	virtual ~PairedInput(){
+		delete m_pending;
 		delete m_f1;
 		delete m_f2;
 		delete m_b;
 	}
 	
 	
-	void* loadPairedReadBundle(){
+	// reads next records of input files, serial, NULL if records are not admitted
+	// by memory limit yet or at end of input
+	void* loadPairedReadData(){
 		
 		using namespace std;
 		using namespace flexbar;
 		
-		TSeqStrs seqs,     seqs2,     seqsBR;
-		TStrings ids,      ids2,      idsBR;
-		TStrings quals,    quals2,    qualsBR;
-		TBools   uncalled, uncalled2, uncalledBR;
+		if(m_pending != NULL){
+			
+			// other stages may recycle bundles meanwhile
+			if(! m_pool.tryAcquire(m_pending->nBytes)){
+				
+				m_pool.waitForRelease();
+				
+				if(! m_pool.tryAcquire(m_pending->nBytes)) return NULL;
+			}
+			
+			PairedReadData *prData = m_pending;
+			m_pending = NULL;
+			
+			return prData;
+		}
 		
 		if(m_nBundles > 0){
-			if(m_nBundles-- == 1) return NULL;
+			if(m_nBundles-- == 1){
+				m_finished = true;
+				return NULL;
+			}
 		}
 		
+		PairedReadData *prData = new PairedReadData();
+		
 		unsigned int bundleSize      = m_bundleSize;
 		if(m_interleaved) bundleSize = m_bundleSize * 2;
 		
-		unsigned int nReads = m_f1->loadSeqReads(uncalled, ids, seqs, quals, bundleSize);
+		unsigned int nReads = m_f1->nextSeqReads(prData->srd, bundleSize);
 		
 		if(m_interleaved && nReads % 2 == 1){
 			cerr << "\nERROR: Interleaved reads input does not contain even number of reads.\n" << endl;
@@ -80,7 +129,7 @@ public:
 		}
 		
 		if(m_isPaired && ! m_interleaved){
-			unsigned int nReads2 = m_f2->loadSeqReads(uncalled2, ids2, seqs2, quals2, m_bundleSize);
+			unsigned int nReads2 = m_f2->nextSeqReads(prData->srd2, m_bundleSize);
 			
 			if(nReads != nReads2){
 				cerr << "\nERROR: Read without counterpart in paired input mode.\n" << endl;
@@ -89,7 +138,7 @@ public:
 		}
 		
 		if(m_useBarRead){
-			unsigned int nBarReads = m_b->loadSeqReads(uncalledBR, idsBR, seqsBR, qualsBR, m_bundleSize);
+			unsigned int nBarReads = m_b->nextSeqReads(prData->srdBR, m_bundleSize);
 			
 			unsigned int multi      = 1;
 			if(m_interleaved) multi = 2;
@@ -104,10 +153,50 @@ public:
 			}
 		}
 		
-		if(nReads == 0) return NULL;
+		if(nReads == 0){
+			delete prData;
+			m_finished = true;
+			return NULL;
+		}
+		
+		// kept while bundles in flight exceed memory limit, empty item is passed
+		// through pipeline so that thread of input filter is not blocked
+		prData->nBytes = getNrBytes(*prData->srd) + getNrBytes(*prData->srd2) + getNrBytes(*prData->srdBR);
+		
+		if(! m_pool.tryAcquire(prData->nBytes)){
+			m_pending = prData;
+			return NULL;
+		}
+		
+		return prData;
+	}
+	
+	
+	bool isFinished() const {
+		return m_finished;
+	}
+	
+	
+	// parses and pre-processes records, builds bundle of paired reads
+	void* processPairedReadData(void* item){
+		
+		using namespace std;
+		using namespace flexbar;
+		
+		PairedReadData *prData = static_cast<PairedReadData* >(item);
 		
+		m_f1->processSeqReads(*prData->srd);
 		
-		TPairedReadBundle *prBundle = new TPairedReadBundle();
+		if(m_isPaired && ! m_interleaved) m_f2->processSeqReads(*prData->srd2);
+		if(m_useBarRead)                  m_b->processSeqReads(*prData->srdBR);
+		
+		TSeqStrs &seqs     = prData->srd->seqs,     &seqs2     = prData->srd2->seqs,     &seqsBR  = prData->srdBR->seqs;
+		TStrings &ids      = prData->srd->ids,      &ids2      = prData->srd2->ids,      &idsBR   = prData->srdBR->ids;
+		TStrings &quals    = prData->srd->quals,    &quals2    = prData->srd2->quals,    &qualsBR = prData->srdBR->quals;
+		TBools   &uncalled = prData->srd->uncalled, &uncalled2 = prData->srd2->uncalled;
+		
+		TPairedReadBundle *prBundle = m_pool.getBundle();
+		prBundle->setNrBytes(prData->nBytes);
 		
 		if(! m_interleaved){
 			
@@ -135,20 +224,18 @@ public:
 						if(m_useBarRead) idsBR[i] = tagCount;
 					}
 					
-					TSeqRead *read1 = NULL, *read2 = NULL, *barRead = NULL;
+					TPairedRead *pRead = prBundle->add();
 					
 					if(m_format == FASTA){
-						                 read1   = new TSeqRead(seqs[i],   ids[i]);
-						if(m_isPaired)   read2   = new TSeqRead(seqs2[i],  ids2[i]);
-						if(m_useBarRead) barRead = new TSeqRead(seqsBR[i], idsBR[i]);
+						                 pRead->r1->set(seqs[i],   ids[i]);
+						if(m_isPaired)   pRead->r2->set(seqs2[i],  ids2[i]);
+						if(m_useBarRead) pRead->b->set(seqsBR[i], idsBR[i]);
 					}
 					else{
-						                 read1   = new TSeqRead(seqs[i],   ids[i],   quals[i]);
-						if(m_isPaired)   read2   = new TSeqRead(seqs2[i],  ids2[i],  quals2[i]);
-						if(m_useBarRead) barRead = new TSeqRead(seqsBR[i], idsBR[i], qualsBR[i]);
+						                 pRead->r1->set(seqs[i],   ids[i],   quals[i]);
+						if(m_isPaired)   pRead->r2->set(seqs2[i],  ids2[i],  quals2[i]);
+						if(m_useBarRead) pRead->b->set(seqsBR[i], idsBR[i], qualsBR[i]);
 					}
-					
-					prBundle->push_back(new TPairedRead(read1, read2, barRead));
 				}
 			}
 		}
@@ -184,55 +271,37 @@ public:
 						if(m_useBarRead) idsBR[i] = tagCount;
 					}
 					
-					TSeqRead *read1 = NULL, *read2 = NULL, *barRead = NULL;
+					TPairedRead *pRead = prBundle->add();
 					
 					if(m_format == FASTA){
-						                 read1   = new TSeqRead(seqs[r],   ids[r]);
-						                 read2   = new TSeqRead(seqs[p],   ids[p]);
-						if(m_useBarRead) barRead = new TSeqRead(seqsBR[i], idsBR[i]);
+						                 pRead->r1->set(seqs[r],   ids[r]);
+						                 pRead->r2->set(seqs[p],   ids[p]);
+						if(m_useBarRead) pRead->b->set(seqsBR[i], idsBR[i]);
 					}
 					else{
-						                 read1   = new TSeqRead(seqs[r],   ids[r],   quals[r]);
-						                 read2   = new TSeqRead(seqs[p],   ids[p],   quals[p]);
-						if(m_useBarRead) barRead = new TSeqRead(seqsBR[i], idsBR[i], qualsBR[i]);
+						                 pRead->r1->set(seqs[r],   ids[r],   quals[r]);
+						                 pRead->r2->set(seqs[p],   ids[p],   quals[p]);
+						if(m_useBarRead) pRead->b->set(seqsBR[i], idsBR[i], qualsBR[i]);
 					}
-					
-					prBundle->push_back(new TPairedRead(read1, read2, barRead));
 				}
 			}
 		}
 		
+		delete prData;
+		
 		return prBundle;
 	}
 	
 	
-	// tbb filter operator
-	void* operator()(void*){
-		
-		using namespace flexbar;
-		
-		TPairedReadBundle *prBundle = NULL;
-		
-		prBundle = static_cast< TPairedReadBundle* >(loadPairedReadBundle());
-		
-		if(prBundle != NULL){
-			
-			while(prBundle->size() == 0){
-				delete prBundle;
-				prBundle = NULL;
-				
-				prBundle = static_cast< TPairedReadBundle* >(loadPairedReadBundle());
-				
-				if(prBundle == NULL) return prBundle;
-			}
-		}
-		
-		return prBundle;
+	// mode of pipeline stage
+	tbb::filter_mode getMode() const {
+		return tbb::filter_mode::serial_in_order;
 	}
 	
-	// virtual
-	void finalize(void* item){
-		
+	
+	// tbb filter operator
+	void* operator()(void*){
+		return loadPairedReadData();
 	}
 	
 	
@@ -265,4 +334,40 @@ public:
 	
 };
 
+
+// parallel stage of input that parses and pre-processes records, serial if
+// reads are numbered in order of input
+
+template <typename TSeqStr, typename TString>
+class PairedInputParser {
+
+private:
+	
+	const tbb::filter_mode m_mode;
+	
+	PairedInput<TSeqStr, TString> &m_input;
+	
+public:
+	
+	PairedInputParser(const Options &o, PairedInput<TSeqStr, TString> &input) :
+		
+		m_mode(o.useNumberTag ? tbb::filter_mode::serial_in_order : tbb::filter_mode::parallel),
+		m_input(input){
+	}
+	
+	
+	tbb::filter_mode getMode() const {
+		return m_mode;
+	}
+	
+	
+	// tbb filter operator
+	void* operator()(void* item){
+		
+		if(item != NULL) return m_input.processPairedReadData(item);
+		
+		return NULL;
+	}
+};
+
 #endif
@@ -6,10 +6,11 @@
 #include "SeqOutput.h"
 #include "SeqOutputFiles.h"
 #include "QualTrimming.h"
+#include "PairedReadPool.h"
 
 
 template <typename TSeqStr, typename TString>
-class PairedOutput : public tbb::filter {
+class PairedOutput {
 
 private:
 	
@@ -18,7 +19,9 @@ private:
 	const bool m_isPaired, m_writeUnassigned, m_writeSingleReads, m_writeSingleReadsP;
 	const bool m_twoBarcodes, m_qtrimPostRm;
 	
-	tbb::atomic<unsigned long> m_nSingleReads, m_nLowPhred;
+	const tbb::filter_mode m_mode;
+	
+	std::atomic<unsigned long> m_nSingleReads, m_nLowPhred;
 	
 	const std::string m_target;
 	
@@ -34,14 +37,23 @@ private:
 	TOutFiles *m_outMap;
 	std::ostream *out;
 	
+	// buffered files of barcoded runs
+	DemuxWriter *m_demux;
+	
+	// output files by buffer index of bundles
+	std::vector<TSeqOutput*> m_outputs;
+	int m_stdoutIdx;
+	
 	tbb::concurrent_vector<flexbar::TBar> *m_adapters,  *m_barcodes;
 	tbb::concurrent_vector<flexbar::TBar> *m_adapters2, *m_barcodes2;
 	
+	PairedReadPool<TSeqStr, TString> &m_pool;
+	
 public:
 	
-	PairedOutput(Options &o) :
+	PairedOutput(Options &o, PairedReadPool<TSeqStr, TString> &pool) :
 		
-		filter(serial_in_order),
+		m_pool(pool),
 		m_target(o.targetName),
 		m_format(o.format),
 		m_runType(o.runType),
@@ -57,6 +69,9 @@ public:
 		m_writeSingleReads(o.writeSingleReads),
 		m_writeSingleReadsP(o.writeSingleReadsP),
 		m_twoBarcodes(o.barDetect == flexbar::WITHIN_READ_REMOVAL2 || o.barDetect == flexbar::WITHIN_READ2),
+		m_stdoutIdx(-1),
+		m_demux(NULL),
+		m_mode(o.unorderedOutput ? tbb::filter_mode::serial_out_of_order : tbb::filter_mode::serial_in_order),
 		out(o.out){
 		
 		using namespace std;
@@ -71,6 +86,16 @@ public:
 		m_nSingleReads = 0;
 		m_nLowPhred    = 0;
 		
+		if(m_runType == PAIRED_BARCODED || m_runType == SINGLE_BARCODED){
+			
+			// pending output follows memory limit, 256 MB otherwise
+			unsigned long maxPending = 268435456;
+			
+			if(o.maxMemory > 0) maxPending = o.maxMemory * 1048576UL;
+			
+			m_demux = new DemuxWriter(o.cmprsType, o.maxOpenFiles, maxPending);
+		}
+		
 		switch(m_runType){
 			
 			case PAIRED_BARCODED:{
@@ -104,10 +129,10 @@ public:
 					b2 << barcode2;
 					
 					string s = m_target + "_barcode_" + b1.str();
-					TSeqOutput *of1 = new TSeqOutput(s, barcode, false, o);
+					TSeqOutput *of1 = new TSeqOutput(s, barcode, false, o, m_demux);
 					
 					s = m_target + "_barcode_" + b2.str();
-					TSeqOutput *of2 = new TSeqOutput(s, barcode, false, o);
+					TSeqOutput *of2 = new TSeqOutput(s, barcode, false, o, m_demux);
 					
 					TOutFiles& f = m_outMap[i + 1];
 					f.f1 = of1;
@@ -115,10 +140,10 @@ public:
 					
 					if(m_writeSingleReads){
 						s = m_target + "_barcode_" + b1.str() + "_single";
-						TSeqOutput *osingle1 = new TSeqOutput(s, "", true, o);
+						TSeqOutput *osingle1 = new TSeqOutput(s, "", true, o, m_demux);
 						
 						s = m_target + "_barcode_" + b2.str() + "_single";
-						TSeqOutput *osingle2 = new TSeqOutput(s, "", true, o);
+						TSeqOutput *osingle2 = new TSeqOutput(s, "", true, o, m_demux);
 						
 						f.single1 = osingle1;
 						f.single2 = osingle2;
@@ -127,10 +152,10 @@ public:
 				
 				if(m_writeUnassigned){
 					string s = m_target + "_barcode_unassigned_1";
-					TSeqOutput *of1 = new TSeqOutput(s, "unassigned", false, o);
+					TSeqOutput *of1 = new TSeqOutput(s, "unassigned", false, o, m_demux);
 					
 					s = m_target + "_barcode_unassigned_2";
-					TSeqOutput *of2 = new TSeqOutput(s, "unassigned", false, o);
+					TSeqOutput *of2 = new TSeqOutput(s, "unassigned", false, o, m_demux);
 					
 					TOutFiles& f = m_outMap[0];
 					f.f1 = of1;
@@ -138,10 +163,10 @@ public:
 					
 					if(m_writeSingleReads){
 						s = m_target + "_barcode_unassigned_1_single";
-						TSeqOutput *osingle1 = new TSeqOutput(s, "", true, o);
+						TSeqOutput *osingle1 = new TSeqOutput(s, "", true, o, m_demux);
 						
 						s = m_target + "_barcode_unassigned_2_single";
-						TSeqOutput *osingle2 = new TSeqOutput(s, "", true, o);
+						TSeqOutput *osingle2 = new TSeqOutput(s, "", true, o, m_demux);
 						
 						f.single1 = osingle1;
 						f.single2 = osingle2;
@@ -214,7 +239,7 @@ public:
 					b << barcode;
 					
 					string s = m_target + "_barcode_" + b.str();
-					TSeqOutput *of1 = new TSeqOutput(s, barcode, false, o);
+					TSeqOutput *of1 = new TSeqOutput(s, barcode, false, o, m_demux);
 					
 					TOutFiles& f = m_outMap[i + 1];
 					f.f1 = of1;
@@ -222,22 +247,56 @@ public:
 				
 				if(m_writeUnassigned){
 					string s = m_target + "_barcode_unassigned";
-					TSeqOutput *of1 = new TSeqOutput(s, "unassigned", false, o);
+					TSeqOutput *of1 = new TSeqOutput(s, "unassigned", false, o, m_demux);
 					
 					TOutFiles& f = m_outMap[0];
 					f.f1 = of1;
 				}
 			}
 		}
+		
+		for(int i = 0; i < m_mapsize; ++i){
+			addOutput(m_outMap[i].f1);
+			addOutput(m_outMap[i].f2);
+			addOutput(m_outMap[i].single1);
+			addOutput(m_outMap[i].single2);
+		}
 	}
 	
 	
 	virtual ~PairedOutput(){
 		delete[] m_outMap;
+		delete m_demux;
 	};
 	
 	
-	void writePairedRead(flexbar::TPairedRead* pRead){
+	// files on stdout share one buffer to keep reads interleaved
+	
+	void addOutput(TSeqOutput *of){
+		
+		if(of == NULL) return;
+		
+		if(of->isStdout()){
+			if(m_stdoutIdx >= 0){
+				of->setBufferIdx(m_stdoutIdx);
+				return;
+			}
+			m_stdoutIdx = m_outputs.size();
+		}
+		
+		of->setBufferIdx(m_outputs.size());
+		m_outputs.push_back(of);
+	}
+	
+	
+	void formatRead(TSeqOutput *of, flexbar::TSeqRead *seqRead, flexbar::TPairedReadBundle *prBundle){
+		of->formatRead(seqRead, prBundle->getBuffer(of->getBufferIdx()));
+	}
+	
+	
+	// filters reads and appends records to buffers of bundle
+	
+	void formatPairedRead(flexbar::TPairedRead* pRead, flexbar::TPairedReadBundle *prBundle){
 		
 		using namespace flexbar;
 		
@@ -261,7 +320,7 @@ public:
 						if     (m_aTrimmed == ATOFF  &&  (pRead->r1->rmAdapter ||   pRead->r1->rmAdapterRC)) r1ok = false;
 						else if(m_aTrimmed == ATONLY && ! pRead->r1->rmAdapter && ! pRead->r1->rmAdapterRC)  r1ok = false;
 						
-						if(r1ok) m_outMap[pRead->barID].f1->writeRead(pRead->r1);
+						if(r1ok) formatRead(m_outMap[pRead->barID].f1, pRead->r1, prBundle);
 					}
 				}
 				break;
@@ -301,41 +360,35 @@ public:
 						else if(m_aTrimmed == ATONLY && ! pRead->r2->rmAdapter && ! pRead->r2->rmAdapterRC && ! pRead->r2->poRemoval)  r2ok = false;
 						
 						if(r1ok && r2ok){
-							m_outMap[outIdx].f1->writeRead(pRead->r1);
-							m_outMap[outIdx].f2->writeRead(pRead->r2);
+							formatRead(m_outMap[outIdx].f1, pRead->r1, prBundle);
+							formatRead(m_outMap[outIdx].f2, pRead->r2, prBundle);
 						}
 						else if(r1ok && ! r2ok){
 							m_nSingleReads++;
 							
 							if(m_writeSingleReads){
-								m_outMap[outIdx].single1->writeRead(pRead->r1);
+								formatRead(m_outMap[outIdx].single1, pRead->r1, prBundle);
 							}
 							else if(m_writeSingleReadsP){
 								
-								pRead->r2->seq = "N";
-								
-								if(m_format == FASTQ)
-								pRead->r2->qual = prefix(pRead->r1->qual, 1);
+								pRead->r2->setToN(*pRead->r1);
 								
-								m_outMap[outIdx].f1->writeRead(pRead->r1);
-								m_outMap[outIdx].f2->writeRead(pRead->r2);
+								formatRead(m_outMap[outIdx].f1, pRead->r1, prBundle);
+								formatRead(m_outMap[outIdx].f2, pRead->r2, prBundle);
 							}
 						}
 						else if(! r1ok && r2ok){
 							m_nSingleReads++;
 							
 							if(m_writeSingleReads){
-								m_outMap[outIdx].single2->writeRead(pRead->r2);
+								formatRead(m_outMap[outIdx].single2, pRead->r2, prBundle);
 							}
 							else if(m_writeSingleReadsP){
 								
-								pRead->r1->seq = "N";
+								pRead->r1->setToN(*pRead->r2);
 								
-								if(m_format == FASTQ)
-								pRead->r1->qual = prefix(pRead->r2->qual, 1);
-								
-								m_outMap[outIdx].f1->writeRead(pRead->r1);
-								m_outMap[outIdx].f2->writeRead(pRead->r2);
+								formatRead(m_outMap[outIdx].f1, pRead->r1, prBundle);
+								formatRead(m_outMap[outIdx].f2, pRead->r2, prBundle);
 							}
 						}
 					}
@@ -345,7 +398,36 @@ public:
 	}
 	
 	
-	// tbb filter operator
+	// mode of pipeline stage, bundles are written as a whole in either mode, so
+	// paired reads and interleaved reads on stdout stay together
+	tbb::filter_mode getMode() const {
+		return m_mode;
+	}
+	
+	
+	void* formatPairedReads(void* item){
+		
+		using namespace flexbar;
+		
+		TPairedReadBundle *prBundle = static_cast< TPairedReadBundle* >(item);
+		
+		for(unsigned int i = 0; i < prBundle->size(); ++i){
+			
+			formatPairedRead(prBundle->at(i), prBundle);
+		}
+		
+		const std::vector<unsigned int> &bufferIds = prBundle->getBufferIds();
+		
+		for(unsigned int i = 0; i < bufferIds.size(); ++i){
+			
+			m_outputs[bufferIds[i]]->compressBuffer(prBundle->getBuffer(bufferIds[i]), prBundle->getBlocks(bufferIds[i]));
+		}
+		
+		return prBundle;
+	}
+	
+	
+	// tbb filter operator, writes formatted records or compressed blocks only
 	void* operator()(void* item){
 		
 		using namespace flexbar;
@@ -354,18 +436,29 @@ public:
 			
 			TPairedReadBundle *prBundle = static_cast< TPairedReadBundle* >(item);
 			
-			for(unsigned int i = 0; i < prBundle->size(); ++i){
+			const std::vector<unsigned int> &bufferIds = prBundle->getBufferIds();
+			
+			for(unsigned int i = 0; i < bufferIds.size(); ++i){
 				
-				writePairedRead(prBundle->at(i));
-				delete prBundle->at(i);
+				m_outputs[bufferIds[i]]->writeBuffer(prBundle->getBuffer(bufferIds[i]), prBundle->getBlocks(bufferIds[i]));
 			}
-			delete prBundle;
+			m_pool.recycle(prBundle);
 		}
 		
 		return NULL;
 	}
 	
 	
+	// closes files after pipeline
+	
+	void finish(){
+		
+		for(unsigned int i = 0; i < m_outputs.size(); ++i) m_outputs[i]->finish();
+		
+		if(m_demux != NULL) m_demux->close();
+	}
+	
+	
 	void writeLengthDist(){
 		
 		for(unsigned int i = 0; i < m_mapsize; i++){
@@ -545,4 +638,32 @@ public:
 	
 };
 
+
+// parallel stage of output that filters reads and formats records into buffers
+// of bundle, run after alignment
+
+template <typename TSeqStr, typename TString>
+class PairedOutputFormatter {
+
+private:
+	
+	PairedOutput<TSeqStr, TString> &m_output;
+	
+public:
+	
+	PairedOutputFormatter(PairedOutput<TSeqStr, TString> &output) :
+		
+		m_output(output){
+	}
+	
+	
+	// tbb filter operator
+	void* operator()(void* item){
+		
+		if(item != NULL) return m_output.formatPairedReads(item);
+		
+		return NULL;
+	}
+};
+
 #endif
@@ -0,0 +1,165 @@
+// PairedReadPool.h
+
+#ifndef FLEXBAR_PAIREDREADPOOL_H
+#define FLEXBAR_PAIREDREADPOOL_H
+
+#include <mutex>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <tbb/concurrent_queue.h>
+
+
+// Bundles written by output filter are handed back to input for next bundles.
+// Reads of a bundle keep their strings, so capacity of sequence, id and quality
+// is reused once pipeline is filled. Input records of bundles in flight are
+// counted against an optional memory limit, input is not admitted until other
+// bundles are recycled. Input waits for recycling with bounded back-off, so the
+// thread of the input filter is not kept from other stages for long.
+
+template <typename TSeqStr, typename TString>
+class PairedReadPool {
+
+private:
+	
+	typedef PairedReadBundle<TSeqStr, TString> TPairedReadBundle;
+	
+	const unsigned int m_bundleSize, m_nThreads;
+	const bool m_isPaired, m_useBarRead;
+	
+	tbb::concurrent_queue<TPairedReadBundle* > m_bundles;
+	
+	const unsigned long m_maxBytes;
+	unsigned long m_nBytes, m_nRetries;
+	double m_waitTime;
+	
+	// start of waiting for admission by input filter
+	std::chrono::steady_clock::time_point m_waitStart;
+	bool m_isWaiting;
+	
+	// wait for release in microseconds, doubled up to limit
+	unsigned int m_backOff;
+	
+	std::mutex m_mutex;
+	std::condition_variable m_released;
+	
+public:
+	
+	PairedReadPool(const Options &o) :
+		m_bundleSize(o.bundleSize),
+		m_nThreads(o.nThreads),
+		m_isPaired(o.isPaired),
+		m_useBarRead(o.barDetect == flexbar::BARCODE_READ),
+		m_maxBytes(o.maxMemory * 1048576ul),
+		m_nBytes(0),
+		m_nRetries(0),
+		m_waitTime(0),
+		m_isWaiting(false),
+		m_backOff(10){
+	};
+	
+	
+	virtual ~PairedReadPool(){
+		
+		TPairedReadBundle *prBundle;
+		
+		while(m_bundles.try_pop(prBundle)) delete prBundle;
+	};
+	
+	
+	TPairedReadBundle* getBundle(){
+		
+		TPairedReadBundle *prBundle;
+		
+		if(m_bundles.try_pop(prBundle)) return prBundle;
+		
+		return new TPairedReadBundle(m_bundleSize, m_isPaired, m_useBarRead);
+	}
+	
+	
+	void recycle(TPairedReadBundle *prBundle){
+		
+		release(prBundle->getNrBytes());
+		
+		prBundle->clear();
+		m_bundles.push(prBundle);
+	}
+	
+	
+	// false if bytes do not fit into limit, a single bundle is always admitted,
+	// called by serial input filter that tries again later without blocking
+	
+	bool tryAcquire(const unsigned long nBytes){
+		
+		using namespace std::chrono;
+		
+		if(m_maxBytes == 0) return true;
+		
+		std::lock_guard<std::mutex> lock(m_mutex);
+		
+		if(m_nBytes > 0 && m_nBytes + nBytes > m_maxBytes){
+			
+			if(! m_isWaiting) m_waitStart = steady_clock::now();
+			
+			m_isWaiting = true;
+			++m_nRetries;
+			
+			return false;
+		}
+		
+		if(m_isWaiting){
+			m_waitTime += duration<double>(steady_clock::now() - m_waitStart).count();
+			m_isWaiting = false;
+		}
+		
+		m_nBytes  += nBytes;
+		m_backOff  = 10;
+		
+		return true;
+	}
+	
+	
+	// waits for release of bundle, at most for back-off time that grows to one
+	// millisecond, returns at once with one thread that has to release bundles
+	
+	void waitForRelease(){
+		
+		if(m_maxBytes == 0 || m_nThreads < 2) return;
+		
+		std::unique_lock<std::mutex> lock(m_mutex);
+		
+		m_released.wait_for(lock, std::chrono::microseconds(m_backOff));
+		
+		m_backOff = std::min(2 * m_backOff, 1000u);
+	}
+	
+	
+	void release(const unsigned long nBytes){
+		
+		if(m_maxBytes == 0) return;
+		
+		std::unique_lock<std::mutex> lock(m_mutex);
+		
+		m_nBytes -= nBytes;
+		
+		lock.unlock();
+		m_released.notify_one();
+	}
+	
+	
+	// seconds from first rejected admission of a bundle until it is admitted
+	
+	double getWaitTime() const {
+		return m_waitTime;
+	}
+	
+	
+	// rejected admissions, each passes an empty item through pipeline
+	
+	unsigned long getNrRetries() const {
+		return m_nRetries;
+	}
+};
+
+
+#endif
@@ -91,12 +91,10 @@ unsigned qualTrimming(const TString& qual, unsigned const cutoff, BWA const &){
 }
 
 
-template <typename TSeqStr, typename TString>
-bool qualTrim(TSeqStr &seq, TString &qual, const flexbar::QualTrimType qtrim, const int cutoff, const int wSize){
-	
-	using namespace seqan;
+template <typename TString>
+unsigned qualTrimPosition(const TString &qual, const flexbar::QualTrimType qtrim, const int cutoff, const int wSize){
 	
-	unsigned cutPos;
+	unsigned cutPos = length(qual);
 	
 	if(qtrim == flexbar::TAIL){
 		cutPos = qualTrimming(qual, cutoff, Tail());
@@ -107,11 +105,21 @@ bool qualTrim(TSeqStr &seq, TString &qual, const flexbar::QualTrimType qtrim, co
 	else if(qtrim == flexbar::BWA){
 		cutPos = qualTrimming(qual, cutoff, BWA());
 	}
+	return cutPos;
+}
+
+
+template <typename TSeqStr, typename TString>
+bool qualTrim(TSeqStr &seq, TString &qual, const flexbar::QualTrimType qtrim, const int cutoff, const int wSize){
+	
+	using namespace seqan;
+	
+	const unsigned cutPos = qualTrimPosition(qual, qtrim, cutoff, wSize);
 	
 	if(cutPos < length(qual)){
 		
-		seq  = prefix(seq,  cutPos);
-		qual = prefix(qual, cutPos);
+		resize(seq,  cutPos);
+		resize(qual, cutPos);
 		
 		return true;
 	}
@@ -122,17 +130,15 @@ bool qualTrim(TSeqStr &seq, TString &qual, const flexbar::QualTrimType qtrim, co
 template <typename TSeqStr, typename TString>
 bool qualTrim(SeqRead<TSeqStr, TString> *seqRead, const flexbar::QualTrimType qtrim, const int cutoff, const int wSize){
 	
-	TSeqStr seq  = seqRead->seq;
-	TString qual = seqRead->qual;
+	const unsigned cutPos = qualTrimPosition(seqRead->qual, qtrim, cutoff, wSize);
 	
-	bool trimmed = qualTrim(seq, qual, qtrim, cutoff, wSize);
-	
-	if(trimmed){
-		seqRead->seq  = seq;
-		seqRead->qual = qual;
+	if(cutPos < length(seqRead->qual)){
+		
+		seqRead->keepPrefix(cutPos);
+		
+		return true;
 	}
-	
-	return trimmed;
+	else return false;
 }
 
 
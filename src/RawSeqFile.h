@@ -0,0 +1,467 @@
+// RawSeqFile.h
+
+#ifndef FLEXBAR_RAWSEQFILE_H
+#define FLEXBAR_RAWSEQFILE_H
+
+#include <string>
+#include <algorithm>
+#include <cctype>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+	#include <immintrin.h>
+#endif
+
+#include "ChunkReader.h"
+
+#if SEQAN_HAS_ZLIB
+	#include "GzipReader.h"
+#endif
+
+#if FLEXBAR_HAS_ZSTD
+	#include "ZstdReader.h"
+#endif
+
+
+namespace flexbar{
+	
+	// first newline in range, end if there is none
+	
+	inline const char* findNewline(const char *p, const char *end){
+	
+	#if defined(__AVX2__)
+		const __m256i nl = _mm256_set1_epi8('\n');
+		
+		for(; p + 32 <= end; p += 32){
+			unsigned int mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)), nl));
+			if(mask != 0) return p + __builtin_ctz(mask);
+		}
+	#elif defined(__SSE2__)
+		const __m128i nl = _mm_set1_epi8('\n');
+		
+		for(; p + 16 <= end; p += 16){
+			unsigned int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), nl));
+			if(mask != 0) return p + __builtin_ctz(mask);
+		}
+	#endif
+		
+		for(; p < end; ++p) if(*p == '\n') return p;
+		
+		return end;
+	}
+	
+	
+	// occurrences of byte in range
+	
+	inline unsigned int countByte(const unsigned char *p, const unsigned char *end, const unsigned char c){
+		
+		unsigned int n = 0;
+		
+	#if defined(__AVX2__)
+		const __m256i v = _mm256_set1_epi8(c);
+		
+		for(; p + 32 <= end; p += 32){
+			unsigned int mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)), v));
+			n += __builtin_popcount(mask);
+		}
+	#elif defined(__SSE2__)
+		const __m128i v = _mm_set1_epi8(c);
+		
+		for(; p + 16 <= end; p += 16){
+			unsigned int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), v));
+			n += __builtin_popcount(mask);
+		}
+	#endif
+		
+		for(; p < end; ++p) if(*p == c) ++n;
+		
+		return n;
+	}
+}
+
+
+// Fasta and fastq records of uncompressed file mapped into memory, or of gz
+// file decompressed into a read-ahead buffer. Record boundaries are found by
+// vectorized newline search and fields are copied in one pass each, instead of
+// character-wise stream parsing. Ranges of records are cut at record boundaries
+// and parsed concurrently, ranges of buffered files are copied.
+
+class RawSeqFile {
+
+private:
+	
+	const char *m_data, *m_pos, *m_end;
+	size_t m_size;
+	int m_fd;
+	
+	// decompressed data not yet cut into ranges
+	std::string m_buffer;
+	bool m_buffered;
+	
+	ChunkReader *m_reader;
+	
+	// sequence characters, blanks are skipped, iupac symbols converted to N
+	char m_nuc[256];
+	
+	
+	static bool readLine(const char* &pos, const char *end, const char* &lineBegin, const char* &lineEnd){
+		
+		if(pos >= end) return false;
+		
+		lineBegin = pos;
+		lineEnd   = flexbar::findNewline(pos, end);
+		pos       = (lineEnd < end) ? lineEnd + 1 : end;
+		
+		if(lineEnd > lineBegin && *(lineEnd - 1) == '\r') --lineEnd;
+		
+		return true;
+	}
+	
+	
+	static void skipEmptyLines(const char* &pos, const char *end){
+		while(pos < end && (*pos == '\n' || *pos == '\r')) ++pos;
+	}
+	
+	
+	template <typename TString>
+	static void appendChars(TString &str, const char *begin, const char *end){
+		
+		const unsigned int n = seqan::length(str);
+		
+		seqan::resize(str, n + (end - begin));
+		std::copy(begin, end, seqan::begin(str, seqan::Standard()) + n);
+	}
+	
+	
+	template <typename TSeqStr>
+	void appendSeq(TSeqStr &seq, const char *begin, const char *end) const {
+		
+		unsigned int n = seqan::length(seq);
+		
+		seqan::resize(seq, n + (end - begin));
+		
+		for(const char *p = begin; p < end; ++p){
+			
+			const char c = m_nuc[static_cast<unsigned char>(*p)];
+			
+			if(c == 0){
+				throw seqan::ParseError(std::string("Unexpected character '") + *p + "' found.");
+			}
+			if(c != ' ') seq[n++] = c;
+		}
+		
+		seqan::resize(seq, n);
+	}
+	
+	
+	template <typename TString, typename TSeqStr>
+	void readFasta(const char* &pos, const char *end, TString &id, TSeqStr &seq) const {
+		
+		const char *lineBegin, *lineEnd;
+		
+		readLine(pos, end, lineBegin, lineEnd);
+		
+		if(*lineBegin != '>') throw seqan::ParseError("Expected '>' at start of fasta record.");
+		
+		appendChars(id, lineBegin + 1, lineEnd);
+		
+		while(pos < end && *pos != '>' && readLine(pos, end, lineBegin, lineEnd))
+			appendSeq(seq, lineBegin, lineEnd);
+		
+		skipEmptyLines(pos, end);
+	}
+	
+	
+	template <typename TString, typename TSeqStr>
+	void readFastq(const char* &pos, const char *end, TString &id, TSeqStr &seq, TString &qual) const {
+		
+		const char *lineBegin, *lineEnd;
+		
+		readLine(pos, end, lineBegin, lineEnd);
+		
+		if(*lineBegin != '@') throw seqan::ParseError("Expected '@' at start of fastq record.");
+		
+		appendChars(id, lineBegin + 1, lineEnd);
+		
+		while(pos < end && *pos != '+' && readLine(pos, end, lineBegin, lineEnd))
+			appendSeq(seq, lineBegin, lineEnd);
+		
+		if(! readLine(pos, end, lineBegin, lineEnd)) throw seqan::ParseError("Expected '+' in fastq record.");
+		
+		while(seqan::length(qual) < seqan::length(seq) && readLine(pos, end, lineBegin, lineEnd))
+			appendChars(qual, lineBegin, lineEnd);
+		
+		if(seqan::length(qual) != seqan::length(seq))
+			throw seqan::ParseError("Qualities and sequence of fastq record differ in length.");
+		
+		skipEmptyLines(pos, end);
+	}
+	
+	
+	// record boundary after fastq record, sequence and quality lines are
+	// measured without copying
+	
+	static void skipFastq(const char* &pos, const char *end){
+		
+		const char *lineBegin, *lineEnd;
+		
+		readLine(pos, end, lineBegin, lineEnd);
+		
+		long seqLength = 0, qualLength = 0;
+		
+		while(pos < end && *pos != '+' && readLine(pos, end, lineBegin, lineEnd))
+			seqLength += lineEnd - lineBegin;
+		
+		readLine(pos, end, lineBegin, lineEnd);
+		
+		while(qualLength < seqLength && readLine(pos, end, lineBegin, lineEnd))
+			qualLength += lineEnd - lineBegin;
+		
+		skipEmptyLines(pos, end);
+	}
+	
+	
+	static void skipFasta(const char* &pos, const char *end){
+		
+		const char *lineBegin, *lineEnd;
+		
+		readLine(pos, end, lineBegin, lineEnd);
+		
+		while(pos < end && *pos != '>' && readLine(pos, end, lineBegin, lineEnd));
+		
+		skipEmptyLines(pos, end);
+	}
+	
+public:
+	
+	RawSeqFile(const bool iupacInput) :
+		m_data(NULL),
+		m_pos(NULL),
+		m_end(NULL),
+		m_size(0),
+		m_fd(-1),
+		m_buffered(false),
+		m_reader(NULL){
+		
+		std::fill(m_nuc, m_nuc + 256, 0);
+		
+		const std::string nucs = "ACGTNU", iupac = "RYSWKMBDHV";
+		
+		for(unsigned int i = 0; i < nucs.length(); ++i){
+			m_nuc[static_cast<int>(nucs[i])]          = nucs[i];
+			m_nuc[static_cast<int>(tolower(nucs[i]))] = nucs[i];
+		}
+		
+		if(iupacInput){
+			for(unsigned int i = 0; i < iupac.length(); ++i){
+				m_nuc[static_cast<int>(iupac[i])]          = 'N';
+				m_nuc[static_cast<int>(tolower(iupac[i]))] = 'N';
+			}
+		}
+		
+		m_nuc[static_cast<int>(' ')]  = ' ';
+		m_nuc[static_cast<int>('\t')] = ' ';
+	};
+	
+	
+	virtual ~RawSeqFile(){
+		close();
+	};
+	
+	
+	bool open(const std::string &path){
+		
+		struct stat st;
+		
+		m_fd = ::open(path.c_str(), O_RDONLY);
+		
+		if(m_fd < 0 || fstat(m_fd, &st) != 0 || ! S_ISREG(st.st_mode)) return false;
+		
+		m_size = st.st_size;
+		
+		if(m_size > 0){
+			void *data = mmap(NULL, m_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+			
+			if(data == MAP_FAILED) return false;
+			
+			madvise(data, m_size, MADV_SEQUENTIAL);
+			
+			m_data = static_cast<const char*>(data);
+		}
+		
+		m_pos = m_data;
+		m_end = m_data + m_size;
+		
+		skipEmptyLines(m_pos, m_end);
+		
+		return true;
+	}
+
+
+#if SEQAN_HAS_ZLIB
+	
+	bool openGzip(const std::string &path, const unsigned int nThreads){
+		
+		m_reader = new GzipReader(nThreads);
+		
+		if(! m_reader->open(path)) return false;
+		
+		m_buffered = true;
+		
+		refill();
+		skipEmptyLines(m_pos, m_end);
+		
+		return true;
+	}
+
+#endif
+
+
+#if FLEXBAR_HAS_ZSTD
+	
+	bool openZstd(const std::string &path){
+		
+		m_reader = new ZstdReader();
+		
+		if(! m_reader->open(path)) return false;
+		
+		m_buffered = true;
+		
+		refill();
+		skipEmptyLines(m_pos, m_end);
+		
+		return true;
+	}
+
+#endif
+	
+	
+	void close(){
+		
+		if(m_data != NULL && ! m_buffered) munmap(const_cast<char*>(m_data), m_size);
+		if(m_fd >= 0) ::close(m_fd);
+		
+		delete m_reader;
+		m_reader = NULL;
+		
+		m_data = m_pos = m_end = NULL;
+		m_fd   = -1;
+	}
+	
+	
+	// appends decompressed chunk to unread part of buffer
+	
+	bool refill(){
+		
+		if(! hasMoreInput()) return false;
+		
+		m_buffer.erase(0, m_pos - m_data);
+		
+		const bool hasChunk = m_reader->read(m_buffer);
+		
+		if(! hasChunk){
+			delete m_reader;
+			m_reader = NULL;
+		}
+		
+		m_data = m_buffer.data();
+		m_pos  = m_data;
+		m_end  = m_data + m_buffer.size();
+		
+		return hasChunk;
+	}
+	
+	
+	bool hasMoreInput() const {
+		return m_reader != NULL;
+	}
+	
+	
+	bool atEnd(){
+		return m_pos >= m_end && ! refill();
+	}
+	
+	
+	// range of next records, copied to data for buffered file, returns number
+	// of records
+	
+	unsigned int readBlock(const char* &begin, const char* &end, std::string &data, const unsigned int nReads, const bool fastq){
+		
+		unsigned int i = 0;
+		const char *pos;
+		
+		// last record in buffer may be incomplete
+		while(true){
+			
+			pos = m_pos;
+			i   = 0;
+			
+			bool complete = true;
+			
+			for(; i < nReads && pos < m_end; ++i){
+				
+				const char *record = pos;
+				
+				if(fastq) skipFastq(pos, m_end);
+				else      skipFasta(pos, m_end);
+				
+				if(pos >= m_end && hasMoreInput()){
+					pos      = record;
+					complete = false;
+					break;
+				}
+			}
+			
+			if((complete && i == nReads) || ! hasMoreInput()) break;
+			
+			refill();
+		}
+		
+		if(m_buffered){
+			data.assign(m_pos, pos);
+			
+			begin = data.data();
+			end   = begin + data.size();
+		}
+		else{
+			begin = m_pos;
+			end   = pos;
+		}
+		
+		m_pos = pos;
+		
+		return i;
+	}
+	
+	
+	// parses records of range, may be called concurrently for disjoint ranges
+	
+	template <typename TStrings, typename TSeqStrs>
+	unsigned int parseRecords(TStrings &ids, TSeqStrs &seqs, TStrings &quals, const char* &pos, const char *end, const unsigned int nReads, const bool fastq) const {
+		
+		unsigned int i = 0;
+		
+		seqan::resize(ids,  nReads);
+		seqan::resize(seqs, nReads);
+		
+		if(fastq) seqan::resize(quals, nReads);
+		
+		for(; i < nReads && pos < end; ++i){
+			if(fastq) readFastq(pos, end, ids[i], seqs[i], quals[i]);
+			else      readFasta(pos, end, ids[i], seqs[i]);
+		}
+		
+		seqan::resize(ids,  i);
+		seqan::resize(seqs, i);
+		
+		if(fastq) seqan::resize(quals, i);
+		
+		return i;
+	}
+};
+
+
+#endif
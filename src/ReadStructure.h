@@ -0,0 +1,143 @@
+// ReadStructure.h
+
+#ifndef FLEXBAR_READSTRUCTURE_H
+#define FLEXBAR_READSTRUCTURE_H
+
+#include <string>
+#include <vector>
+#include <cctype>
+
+
+// Fixed layout of reads like 8B12M+T, given as segments of length and type,
+// B for barcode, M for UMI, S for skipped bases and T for template. Length +
+// for the last segment covers the rest of the read. Barcode, UMI and template
+// segments are cut by offset without alignment, several segments of one type
+// are concatenated.
+
+class ReadStructure {
+
+private:
+	
+	struct Segment {
+		char type;
+		int length;
+	};
+	
+	std::vector<Segment> m_segments;
+	
+public:
+	
+	ReadStructure(){};
+	
+	
+	bool parse(const std::string &structure){
+		
+		m_segments.clear();
+		
+		unsigned int i = 0;
+		
+		while(i < structure.length()){
+			
+			Segment s;
+			s.length = 0;
+			
+			if(structure[i] == '+'){
+				s.length = -1;
+				++i;
+			}
+			else{
+				while(i < structure.length() && isdigit(structure[i]) && s.length < 100000){
+					s.length = 10 * s.length + (structure[i] - '0');
+					++i;
+				}
+				if(s.length < 1) return false;
+			}
+			
+			if(i == structure.length()) return false;
+			
+			s.type = toupper(structure[i++]);
+			
+			if(s.type != 'B' && s.type != 'M' && s.type != 'S' && s.type != 'T') return false;
+			
+			if(m_segments.size() > 0 && m_segments.back().length < 0) return false;
+			
+			m_segments.push_back(s);
+		}
+		return m_segments.size() > 0;
+	}
+	
+	
+	bool empty() const {
+		return m_segments.size() == 0;
+	}
+	
+	
+	bool hasSegment(const char type) const {
+		
+		for(unsigned int i = 0; i < m_segments.size(); ++i)
+			if(m_segments[i].type == type) return true;
+		
+		return false;
+	}
+	
+	
+	int getLength(const char type) const {
+		
+		int len = 0;
+		
+		for(unsigned int i = 0; i < m_segments.size(); ++i){
+			if(m_segments[i].type == type){
+				if(m_segments[i].length < 0) return -1;
+				len += m_segments[i].length;
+			}
+		}
+		return len;
+	}
+	
+	
+	// sets barcode and UMI of read, keeps template segments and barcodes if
+	// requested in read sequence and quality, segments beyond read end are cut
+	// short, kept segments are moved forward within read
+	
+	template <typename TSeqStr, typename TString>
+	void cut(SeqRead<TSeqStr, TString> *seqRead, TSeqStr &barcode, TSeqStr &umi, const bool keepBarcode, const bool hasQuality) const {
+		
+		using namespace seqan;
+		
+		const unsigned int readLength = length(seqRead->seq);
+		
+		unsigned int pos = 0, kept = 0;
+		
+		for(unsigned int i = 0; i < m_segments.size(); ++i){
+			
+			const char type  = m_segments[i].type;
+			unsigned int end = readLength;
+			
+			if(m_segments[i].length >= 0 && pos + m_segments[i].length < readLength)
+				end = pos + m_segments[i].length;
+			
+			if(pos < end){
+				
+				     if(type == 'B') append(barcode, infix(seqRead->seq, pos, end));
+				else if(type == 'M') append(umi,     infix(seqRead->seq, pos, end));
+				
+				if(type == 'T' || (type == 'B' && keepBarcode)){
+					
+					if(kept == pos) kept = end;
+					else{
+						for(unsigned int k = pos; k < end; ++k, ++kept){
+							seqRead->seq[kept] = seqRead->seq[k];
+							if(hasQuality) seqRead->qual[kept] = seqRead->qual[k];
+						}
+					}
+				}
+			}
+			pos = end;
+		}
+		
+		seqRead->keepPrefix(kept);
+	}
+};
+
+
+#endif
@@ -3,7 +3,11 @@
 #ifndef FLEXBAR_SEQALIGN_H
 #define FLEXBAR_SEQALIGN_H
 
-tbb::mutex ouputMutex;
+#include "SeqAlignAlgo.h"
+#include "SeqAlignFilter.h"
+#include "BarcodeIndex.h"
+
+std::mutex ouputMutex;
 
 template <typename TSeqStr, typename TString, class TAlgorithm>
 class SeqAlign {
@@ -16,18 +20,39 @@ private:
 	const flexbar::FileFormat  m_format;
 	const flexbar::PairOverlap m_poMode;
 	
-	const bool m_isBarcoding, m_writeTag, m_umiTags, m_strictRegion, m_addBarcodeAdapter;
-	const int m_minLength, m_minOverlap, m_tailLength;
+	const bool m_isBarcoding, m_writeTag, m_umiTags, m_strictRegion, m_addBarcodeAdapter, m_useFilter, m_useTrie;
+	bool m_useHash;
+	const int m_minLength, m_minOverlap, m_tailLength, m_match, m_mismatch;
+	int m_trieErrors, m_trieOverhang;
 	const float m_errorRate;
 	const unsigned int m_bundleSize;
 	
-	tbb::atomic<unsigned long> m_nPreShortReads, m_modified;
+	std::atomic<unsigned long> m_nPreShortReads, m_modified, m_nAlignments, m_nSkipped, m_nAmbiguous;
 	tbb::concurrent_vector<flexbar::TBar> *m_queries;
 	tbb::concurrent_vector<unsigned long> m_rmOverlaps;
 	
 	std::ostream *m_out;
 	TAlgorithm m_algo;
 	
+	// read codes, queries with seeds and search buffers for each thread
+	struct FilterData {
+		std::vector<int16_t> read;
+		std::vector<char> seeds;
+		
+		std::vector<std::pair<int, int> > scores;
+		std::vector<unsigned int> candIdx;
+		
+		std::vector<std::pair<int, unsigned int> > hits;
+		std::vector<int> rows;
+		TSeqStr tail;
+	};
+	
+	SeqAlignFilter m_filter;
+	tbb::enumerable_thread_specific<FilterData> m_filterData;
+	
+	BarcodeHash m_barcodeHash;
+	BarcodeTrie m_barcodeTrie;
+	
 public:
 	
 	SeqAlign(tbb::concurrent_vector<flexbar::TBar> *queries, const Options &o, int minOverlap, float errorRate, const int tailLength, const int match, const int mismatch, const int gapCost, const bool isBarcoding):
@@ -44,14 +69,74 @@ public:
 			m_writeTag(o.useRemovalTag),
 			m_addBarcodeAdapter(o.addBarcodeAdapter),
 			m_strictRegion(! o.relaxRegion),
+			m_useFilter(o.seedFilter && ! o.relaxRegion),
+			m_useHash(o.barcodeHash && isBarcoding),
+			m_useTrie(o.barcodeTrie && isBarcoding && (o.b_end == flexbar::LTAIL || o.b_end == flexbar::RTAIL)),
+			m_trieErrors(0),
+			m_trieOverhang(0),
+			m_match(match),
+			m_mismatch(mismatch),
 			m_bundleSize(o.bundleSize),
 			m_out(o.out),
 			m_nPreShortReads(0),
 			m_modified(0),
-			m_algo(TAlgorithm(o, match, mismatch, gapCost, ! isBarcoding)){
+			m_nAlignments(0),
+			m_nSkipped(0),
+			m_nAmbiguous(0),
+			m_algo(TAlgorithm(o, match, mismatch, gapCost, ! isBarcoding)),
+			m_filter(errorRate, ! isBarcoding){
 		
 		m_queries    = queries;
 		m_rmOverlaps = tbb::concurrent_vector<unsigned long>(flexbar::MAX_READLENGTH + 1, 0);
+		
+		if(m_useFilter){
+			std::vector<int16_t> codes;
+			
+			for(unsigned int i = 0; i < m_queries->size(); ++i){
+				SeqAlignAlgo<TSeqStr>::assignCodes(codes, m_queries->at(i).seq);
+				m_filter.addQuery(codes);
+			}
+			m_filter.build();
+		}
+		
+		if(m_useHash){
+			std::vector<int16_t> codes;
+			
+			for(unsigned int i = 0; i < m_queries->size(); ++i){
+				SeqAlignAlgo<TSeqStr>::assignCodes(codes, m_queries->at(i).seq);
+				m_barcodeHash.addBarcode(codes);
+			}
+			
+			int maxMismatches = 0;
+			
+			if(m_queries->size() > 0){
+				int len = length(m_queries->at(0).seq);
+				while(static_cast<float>(maxMismatches + 1) <= m_errorRate * len) ++maxMismatches;
+			}
+			
+			m_useHash = m_barcodeHash.build(maxMismatches);
+		}
+		
+		// barcodes are reversed for search from read end
+		
+		if(m_useTrie){
+			std::vector<int16_t> codes;
+			
+			for(unsigned int i = 0; i < m_queries->size(); ++i){
+				SeqAlignAlgo<TSeqStr>::assignCodes(codes, m_queries->at(i).seq);
+				
+				if(o.b_end == flexbar::RTAIL) std::reverse(codes.begin(), codes.end());
+				m_barcodeTrie.addBarcode(codes, i);
+			}
+			
+			// max errors e <= errorRate * (length + e) of longest barcode
+			
+			const int len = m_barcodeTrie.getMaxLength();
+			while(static_cast<float>(m_trieErrors + 1) <= m_errorRate * (len + m_trieErrors + 1)) ++m_trieErrors;
+			
+			// barcodes may overhang read if min overlap is shorter
+			if(m_minOverlap > 0 && m_minOverlap < len) m_trieOverhang = len - m_minOverlap;
+		}
 	};
 	
 	
@@ -74,42 +159,49 @@ public:
 		if(readLength < 1) return 0;
 		
 		
+		int mismatches = 0;
+		
 		if(cycle == PRELOAD){
 			
-			if(idxAl == 0) reserve(alignments.aset, m_bundleSize * m_queries->size());
+			// reads assigned by barcode lookup or search are not preloaded
+			if(m_useTrie) return 0;
+			
+			if(m_useHash){
+				int qIndex = lookupBarcode(mismatches, seqRead, trimEnd);
+				
+				alignments.lookups.push_back(std::make_pair(qIndex, mismatches));
+				
+				if(qIndex >= 0) return 0;
+			}
+			
+			if(idxAl == 0) alignments.candidates.reserve(m_bundleSize * m_queries->size());
 			
 			for(unsigned int i = 0; i < m_queries->size(); ++i){
 				
 				if     (alMode == ALIGNRCOFF &&   m_queries->at(i).rcAdapter) continue;
 				else if(alMode == ALIGNRC    && ! m_queries->at(i).rcAdapter) continue;
 				
-				TSeqStr *qseq = &m_queries->at(i).seq;
-				TSeqStr *rseq = &seqRead.seq;
-				TSeqStr tmp, tmpq;
+				alignments.candidates.push_back(AlignCandidate());
+				AlignCandidate &c = alignments.candidates.back();
+				
+				c.queryPtr = &m_queries->at(i).seq;
+				c.readCopy = seqRead.seq;
 				
 				if(! m_isBarcoding && m_addBarcodeAdapter && addBarcode != ""){
-					tmpq = addBarcode;
-					append(tmpq, m_queries->at(i).seq);
-					qseq = &tmpq;
+					c.queryCopy = addBarcode;
+					append(c.queryCopy, m_queries->at(i).seq);
+					c.queryPtr = NULL;
 				}
 				
 				if(trimEnd == LTAIL || trimEnd == RTAIL){
-					int tailLength  = (m_tailLength > 0) ? m_tailLength : length(*qseq);
+					int tailLength  = (m_tailLength > 0) ? m_tailLength : length(c.query());
 					
 					if(tailLength < readLength){
-						if(trimEnd == LTAIL) tmp = prefix(seqRead.seq, tailLength);
-						else                 tmp = suffix(seqRead.seq, readLength - tailLength);
-						rseq = &tmp;
+						if(trimEnd == LTAIL) c.readCopy = prefix(seqRead.seq, tailLength);
+						else                 c.readCopy = suffix(seqRead.seq, readLength - tailLength);
 					}
 				}
 				
-				TAlign align;
-				appendValue(alignments.aset, align);
-				resize(rows(alignments.aset[idxAl]), 2);
-				
-				assignSource(row(alignments.aset[idxAl], 0), *rseq);
-				assignSource(row(alignments.aset[idxAl], 1), *qseq);
-				
 				++idxAl;
 			}
 			return 0;
@@ -117,55 +209,19 @@ public:
 		
 		TAlignResults am;
 		
-		int qIndex  = -1;
-		int amScore = numeric_limits<int>::min();
+		int qIndex = -1;
 		
-		// align each query sequence and store best one
-		for(unsigned int i = 0; i < m_queries->size(); ++i){
-			
-			if     (alMode == ALIGNRCOFF &&   m_queries->at(i).rcAdapter) continue;
-			else if(alMode == ALIGNRC    && ! m_queries->at(i).rcAdapter) continue;
-			
-			TAlignResults a;
-			
-			// global sequence alignment
-			m_algo.alignGlobal(a, alignments, cycle, idxAl++, trimEnd);
-			
-			a.queryLength = length(m_queries->at(i).seq);
-			
-			if(! m_isBarcoding && m_addBarcodeAdapter && addBarcode != ""){
-				a.queryLength += length(addBarcode);
-			}
-			
-			a.tailLength  = (m_tailLength > 0) ? m_tailLength : a.queryLength;
-			
-			a.overlapLength = a.endPos - a.startPos;
-			a.allowedErrors = m_errorRate * a.overlapLength;
-			
-			float madeErrors = static_cast<float>(a.mismatches + a.gapsR + a.gapsA);
-			int minOverlap   = (m_isBarcoding && m_minOverlap == 0) ? a.queryLength : m_minOverlap;
-			
-			if(! m_isBarcoding && m_poMode == PON && seqRead.pairOverlap &&
-				(trimEnd == RIGHT || trimEnd == RTAIL)) minOverlap = 1;
-			
-			bool validAl = true;
-			
-			if(((trimEnd == RTAIL  || trimEnd == RIGHT) && a.startPosA < a.startPosS && m_strictRegion) ||
-			   ((trimEnd == LTAIL  || trimEnd == LEFT)  && a.endPosA   > a.endPosS   && m_strictRegion) ||
-			     a.overlapLength < 1){
-				
-				validAl = false;
-			}
-			
-			// check if alignment is valid, score max, number of errors and overlap length
-			if(validAl && a.score > amScore && madeErrors <= a.allowedErrors && a.overlapLength >= minOverlap){
-				
-				am      = a;
-				amScore = a.score;
-				qIndex  = i;
-			}
+		if(m_useTrie) qIndex = lookupBarcode(mismatches, seqRead, trimEnd);
+		else if(m_useHash){
+			qIndex     = alignments.lookups[alignments.idxLookup].first;
+			mismatches = alignments.lookups[alignments.idxLookup].second;
+			++alignments.idxLookup;
 		}
 		
+		if     (qIndex >= 0) setBarcodeResults(am, seqRead, qIndex, mismatches, trimEnd);
+		else if(m_useTrie)   qIndex = searchBarcodes(am, seqRead, trimEnd);
+		else                 qIndex = alignQueries(am, seqRead, alignments, idxAl, alMode, trimEnd, addBarcode);
+		
 		stringstream s;
 		
 		// valid alignment
@@ -179,8 +235,7 @@ public:
 				if(trEnd == ANY){
 					
 					if(am.startPosA <= am.startPosS && am.endPosS <= am.endPosA){
-						seqRead.seq = "";
-						if(m_format == FASTQ) seqRead.qual = "";
+						seqRead.keepPrefix(0);
 					}
 					else if(am.startPosA - am.startPosS >= am.endPosS - am.endPosA){
 						trEnd = RIGHT;
@@ -204,10 +259,7 @@ public:
 						
 						if(rCutPos > readLength) rCutPos = readLength;
 						
-						erase(seqRead.seq, 0, rCutPos);
-						
-						if(m_format == FASTQ)
-						erase(seqRead.qual, 0, rCutPos);
+						seqRead.cutPrefix(rCutPos);
 						
 						break;
 					
@@ -221,10 +273,7 @@ public:
 						// skipped restriction
 						if(rCutPos < 0) rCutPos = 0;
 						
-						erase(seqRead.seq, rCutPos, readLength);
-						
-						if(m_format == FASTQ)
-						erase(seqRead.qual, rCutPos, readLength);
+						seqRead.keepPrefix(rCutPos);
 						
 						break;
 						
@@ -314,6 +363,288 @@ public:
 	}
 	
 	
+	// score each query sequence, then traceback in order of score
+	// until valid alignment is found, ties resolved by query order
+	
+	int alignQueries(TAlignResults &am, flexbar::TSeqRead &seqRead, flexbar::Alignments &alignments, unsigned int &idxAl, const flexbar::AlignmentMode &alMode, const flexbar::TrimEnd trimEnd, const TSeqStr &addBarcode){
+		
+		using namespace std;
+		using namespace flexbar;
+		
+		int qIndex = -1;
+		
+		FilterData &fd = m_filterData.local();
+		
+		vector<pair<int, int> > &scores = fd.scores;
+		vector<unsigned int> &candIdx   = fd.candIdx;
+		
+		scores.clear();
+		candIdx.resize(m_queries->size());
+		
+		// read scanned for seeds of all queries
+		bool seedsFound = false;
+		
+		unsigned long nAlignments = 0, nSkipped = 0;
+		
+		for(unsigned int i = 0; i < m_queries->size(); ++i){
+			
+			if     (alMode == ALIGNRCOFF &&   m_queries->at(i).rcAdapter) continue;
+			else if(alMode == ALIGNRC    && ! m_queries->at(i).rcAdapter) continue;
+			
+			const AlignCandidate &c = alignments.candidates[idxAl];
+			candIdx[i] = idxAl++;
+			
+			int minOverlap = getMinOverlap(seqRead, i, trimEnd);
+			
+			++nAlignments;
+			
+			if(isFiltered(seqRead, c, i, trimEnd, minOverlap, seedsFound)){
+				++nSkipped;
+				continue;
+			}
+			
+			int score = m_algo.alignScore(c.read(), c.query(), trimEnd, minOverlap);
+			
+			if(score > numeric_limits<int>::min()) scores.push_back(make_pair(-score, i));
+		}
+		
+		if(m_useFilter){
+			m_nAlignments += nAlignments;
+			m_nSkipped    += nSkipped;
+		}
+		
+		sort(scores.begin(), scores.end());
+		
+		for(unsigned int k = 0; k < scores.size(); ++k){
+			
+			const unsigned int i = scores[k].second;
+			const AlignCandidate &c = alignments.candidates[candIdx[i]];
+			
+			TAlignResults a;
+			
+			a.queryLength = length(m_queries->at(i).seq);
+			
+			if(! m_isBarcoding && m_addBarcodeAdapter && addBarcode != ""){
+				a.queryLength += length(addBarcode);
+			}
+			
+			a.tailLength  = (m_tailLength > 0) ? m_tailLength : a.queryLength;
+			
+			int minOverlap = getMinOverlap(seqRead, i, trimEnd);
+			
+			// sequence alignment with traceback
+			m_algo.alignTraceback(a, c.read(), c.query(), trimEnd, minOverlap);
+			
+			if(isValidAlignment(a, trimEnd, minOverlap)){
+				
+				am      = a;
+				qIndex  = i;
+				break;
+			}
+		}
+		
+		return qIndex;
+	}
+	
+	
+	bool isValidAlignment(TAlignResults &a, const flexbar::TrimEnd trimEnd, const int minOverlap){
+		
+		using namespace flexbar;
+		
+		a.overlapLength = a.endPos - a.startPos;
+		a.allowedErrors = m_errorRate * a.overlapLength;
+		
+		float madeErrors = static_cast<float>(a.mismatches + a.gapsR + a.gapsA);
+		
+		bool validAl = true;
+		
+		if(((trimEnd == RTAIL  || trimEnd == RIGHT) && a.startPosA < a.startPosS && m_strictRegion) ||
+		   ((trimEnd == LTAIL  || trimEnd == LEFT)  && a.endPosA   > a.endPosS   && m_strictRegion) ||
+		     a.overlapLength < 1){
+			
+			validAl = false;
+		}
+		
+		// check if alignment is valid, number of errors and overlap length
+		return validAl && madeErrors <= a.allowedErrors && a.overlapLength >= minOverlap;
+	}
+	
+	
+	// barcodes close to read tail in trie, all of them are aligned and the
+	// best valid alignment is kept, ties resolved by query order
+	
+	int searchBarcodes(TAlignResults &am, const flexbar::TSeqRead &seqRead, const flexbar::TrimEnd trimEnd){
+		
+		using namespace std;
+		using namespace flexbar;
+		
+		const int readLength = length(seqRead.seq);
+		const int w          = min(readLength, (m_tailLength > 0) ? m_tailLength : m_barcodeTrie.getMaxLength());
+		
+		FilterData &fd = m_filterData.local();
+		
+		vector<int16_t> &codes = fd.read;
+		
+		if(trimEnd == LTAIL) SeqAlignAlgo<TSeqStr>::assignCodes(codes, prefix(seqRead.seq, w));
+		else{
+			SeqAlignAlgo<TSeqStr>::assignCodes(codes, suffix(seqRead.seq, readLength - w));
+			reverse(codes.begin(), codes.end());
+		}
+		
+		m_barcodeTrie.find(fd.hits, fd.rows, codes.data(), w, m_trieOverhang, m_trieErrors);
+		
+		int qIndex = -1;
+		bool isTie = false;
+		
+		for(unsigned int k = 0; k < fd.hits.size(); ++k){
+			
+			const unsigned int i = fd.hits[k].second;
+			
+			TAlignResults a;
+			
+			a.queryLength = length(m_queries->at(i).seq);
+			a.tailLength  = (m_tailLength > 0) ? m_tailLength : a.queryLength;
+			
+			if(a.tailLength < readLength){
+				if(trimEnd == LTAIL) fd.tail = prefix(seqRead.seq, a.tailLength);
+				else                 fd.tail = suffix(seqRead.seq, readLength - a.tailLength);
+			}
+			else fd.tail = seqRead.seq;
+			
+			int minOverlap = getMinOverlap(seqRead, i, trimEnd);
+			
+			m_algo.alignTraceback(a, fd.tail, m_queries->at(i).seq, trimEnd, minOverlap);
+			
+			if(! isValidAlignment(a, trimEnd, minOverlap)) continue;
+			
+			if(qIndex < 0 || a.score > am.score || (a.score == am.score && i < (unsigned int) qIndex)){
+				
+				isTie  = qIndex >= 0 && a.score == am.score;
+				am     = a;
+				qIndex = i;
+			}
+			else if(a.score == am.score) isTie = true;
+		}
+		
+		if(isTie) ++m_nAmbiguous;
+		
+		return qIndex;
+	}
+	
+	
+	// index of barcode at read tail by mismatch lookup, -1 if not found or ambiguous
+	
+	int lookupBarcode(int &mismatches, const flexbar::TSeqRead &seqRead, const flexbar::TrimEnd trimEnd){
+		
+		using namespace flexbar;
+		
+		if(! m_useHash || (trimEnd != LTAIL && trimEnd != RTAIL)) return -1;
+		
+		const int readLength = length(seqRead.seq);
+		const int len        = m_barcodeHash.getLength();
+		
+		if(readLength < len || (m_tailLength > 0 && m_tailLength != len)) return -1;
+		
+		std::vector<int16_t> &codes = m_filterData.local().read;
+		
+		if(trimEnd == LTAIL) SeqAlignAlgo<TSeqStr>::assignCodes(codes, prefix(seqRead.seq, len));
+		else                 SeqAlignAlgo<TSeqStr>::assignCodes(codes, suffix(seqRead.seq, readLength - len));
+		
+		int index;
+		
+		if(! m_barcodeHash.lookup(index, mismatches, codes.data(), len)) return -1;
+		
+		if(getMinOverlap(seqRead, index, trimEnd) > len) return -1;
+		
+		return index;
+	}
+	
+	
+	// ungapped alignment of barcode over whole read tail
+	
+	void setBarcodeResults(TAlignResults &am, const flexbar::TSeqRead &seqRead, const unsigned int i, const int mismatches, const flexbar::TrimEnd trimEnd){
+		
+		using namespace std;
+		using namespace seqan;
+		using namespace flexbar;
+		
+		const int len = length(m_queries->at(i).seq);
+		
+		am.queryLength   = len;
+		am.tailLength    = len;
+		am.score         = (len - mismatches) * m_match + mismatches * m_mismatch;
+		am.startPosS     = 0;
+		am.startPosA     = 0;
+		am.endPosS       = len;
+		am.endPosA       = len;
+		am.startPos      = 0;
+		am.endPos        = len;
+		am.mismatches    = mismatches;
+		am.gapsR         = 0;
+		am.gapsA         = 0;
+		am.overlapLength = len;
+		am.allowedErrors = m_errorRate * len;
+		
+		if(m_umiTags) am.umiTag = "";
+		
+		if(m_log != NONE){
+			
+			TSeqStr tail;
+			
+			if(trimEnd == LTAIL) tail = prefix(seqRead.seq, len);
+			else                 tail = suffix(seqRead.seq, length(seqRead.seq) - len);
+			
+			TAlign align;
+			resize(rows(align), 2);
+			
+			assignSource(row(align, 0), tail);
+			assignSource(row(align, 1), m_queries->at(i).seq);
+			
+			stringstream s;
+			s << align;
+			am.alString = s.str();
+		}
+	}
+	
+	
+	// no valid alignment possible according to seed filter, which is applied
+	// to whole read also for tail modes, as it contains the tail
+	
+	bool isFiltered(const flexbar::TSeqRead &seqRead, const flexbar::AlignCandidate &c, const unsigned int i, const flexbar::TrimEnd trimEnd, const int minOverlap, bool &seedsFound){
+		
+		using namespace flexbar;
+		
+		if(! m_useFilter || trimEnd == ANY || c.queryPtr == NULL || ! m_filter.isEligible(i)) return false;
+		
+		FilterData &fd = m_filterData.local();
+		
+		if(! seedsFound){
+			SeqAlignAlgo<TSeqStr>::assignCodes(fd.read, seqRead.seq);
+			m_filter.findSeeds(fd.seeds, fd.read.data(), fd.read.size());
+			seedsFound = true;
+		}
+		
+		if(fd.seeds[i]) return false;
+		
+		const bool leftEnd = (trimEnd == LEFT || trimEnd == LTAIL);
+		
+		return ! m_filter.hasTerminalOverlap(i, fd.read.data(), fd.read.size(), leftEnd, minOverlap);
+	}
+	
+	
+	int getMinOverlap(const flexbar::TSeqRead &seqRead, const unsigned int i, const flexbar::TrimEnd trimEnd){
+		
+		using namespace flexbar;
+		
+		if(m_isBarcoding && m_minOverlap == 0) return length(m_queries->at(i).seq);
+		
+		if(! m_isBarcoding && m_poMode == PON && seqRead.pairOverlap &&
+			(trimEnd == RIGHT || trimEnd == RTAIL)) return 1;
+		
+		return m_minOverlap;
+	}
+	
+	
 	std::string getOverlapStatsString(){
 		
 		using namespace std;
@@ -365,6 +696,21 @@ public:
 		return m_modified;
 	}
 	
+	
+	unsigned long getNrAlignments() const {
+		return m_nAlignments;
+	}
+	
+	
+	unsigned long getNrSkippedAlignments() const {
+		return m_nSkipped;
+	}
+	
+	
+	unsigned long getNrAmbiguousReads() const {
+		return m_nAmbiguous;
+	}
+	
 };
 
 #endif
@@ -3,6 +3,8 @@
 #ifndef FLEXBAR_SEQALIGNALGO_H
 #define FLEXBAR_SEQALIGNALGO_H
 
+#include "SeqAlignKernel.h"
+
 
 template <typename TSeqStr>
 class SeqAlignAlgo {
@@ -21,15 +23,34 @@ private:
 	// TScoreSimple m_score;
 	TScoreMatrix m_scoreMatrix;
 	
-	const bool m_umiTags, m_isAdapterRm;
+	const bool m_umiTags, m_isAdapterRm, m_banded, m_ungapped, m_seqanOnly;
+	const float m_errorRate;
 	const flexbar::LogAlign m_log;
 	
+	// kernel and sequence codes for each thread
+	struct KernelData {
+		
+		SeqAlignKernel kernel;
+		SeqAlignUngappedKernel ungapped;
+		flexbar::KernelResult result;
+		std::vector<int16_t> read, query;
+		
+		KernelData(const SeqAlignKernel &k, const SeqAlignUngappedKernel &u) : kernel(k), ungapped(u){}
+	};
+	
+	tbb::enumerable_thread_specific<KernelData> m_kernelData;
+	
 public:
 	
 	SeqAlignAlgo(const Options &o, const int match, const int mismatch, const int gapCost, const bool isAdapterRm):
 			m_umiTags(o.umiTags),
 			m_isAdapterRm(isAdapterRm),
-			m_log(o.logAlign){
+			m_banded(o.bandedAlign && isAdapterRm && ! o.relaxRegion),
+			m_ungapped(o.ungappedAlign && isAdapterRm && ! o.relaxRegion),
+			m_seqanOnly(o.alignEngine == flexbar::ALIGNSEQAN),
+			m_errorRate(o.a_errorRate),
+			m_log(o.logAlign),
+			m_kernelData(KernelData(SeqAlignKernel(match, mismatch, gapCost, isAdapterRm), SeqAlignUngappedKernel(match, mismatch, isAdapterRm))){
 		
 		using namespace seqan;
 		
@@ -49,43 +70,174 @@ public:
 	};
 	
 	
-	void alignGlobal(TAlignResults &a, flexbar::Alignments &alignments, flexbar::ComputeCycle &cycle, const unsigned int idxAl, const flexbar::TrimEnd trimEnd){
+	// alignment of preloaded rows, as used for pair overlap detection
+	
+	void alignGlobal(TAlignResults &a, flexbar::Alignments &alignments, flexbar::ComputeCycle &cycle, const unsigned int idxAl, const flexbar::TrimEnd trimEnd, const int minOverlap = 0){
 		
-		using namespace std;
 		using namespace seqan;
 		using namespace flexbar;
 		
-		// int band1 = overhang;
-		// int band2 = readLen - minOvl;
+		if(cycle == COMPUTE) cycle = RESULTS;
 		
-		// appendValue(alignments.ascores, 0);
-		// AlignConfig<true, true, true, true> ac;
+		TAlign &align = alignments.aset[idxAl];
+		
+		alignTraceback(a, source(row(align, 0)), source(row(align, 1)), trimEnd, minOverlap);
+	}
+	
+	
+	// score of best alignment without traceback
+	
+	int alignScore(const TSeqStr &read, const TSeqStr &query, const flexbar::TrimEnd trimEnd, const int minOverlap){
 		
-		// alignments.ascores[idxAl] = globalAlignment(alignments.aset[idxAl], m_scoreMatrix, ac, band1, band2);
+		using namespace flexbar;
 		
+		if(m_seqanOnly){
+			TAlign align;
+			return alignSeqan(align, read, query, trimEnd);
+		}
 		
-		if(cycle == COMPUTE){
+		KernelData &kd = m_kernelData.local();
+		
+		assignCodes(kd.read,  read);
+		assignCodes(kd.query, query);
+		
+		if(alignUngapped(kd, trimEnd, minOverlap)) return kd.result.score;
+		
+		KernelConfig kc = getKernelConfig(kd, trimEnd, minOverlap);
+		
+		if(kd.kernel.align(kd.result, kd.read.data(), kd.read.size(), kd.query.data(), kd.query.size(), kc, false))
+			return kd.result.score;
+		
+		TAlign align;
+		return alignSeqan(align, read, query, trimEnd);
+	}
+	
+	
+	// vectorized semi-global alignment, same results as globalAlignment
+	
+	void alignTraceback(TAlignResults &a, const TSeqStr &read, const TSeqStr &query, const flexbar::TrimEnd trimEnd, const int minOverlap){
+		
+		using namespace flexbar;
+		
+		if(m_seqanOnly){
+			TAlign align;
+			a.score = alignSeqan(align, read, query, trimEnd);
 			
-			cycle = RESULTS;
+			setAlignResults(a, align);
+			return;
+		}
+		
+		KernelData &kd = m_kernelData.local();
+		
+		assignCodes(kd.read,  read);
+		assignCodes(kd.query, query);
+		
+		if(alignUngapped(kd, trimEnd, minOverlap)){
+			setKernelResults(a, kd.result, read, query, kd.query);
+			return;
+		}
+		
+		KernelConfig kc = getKernelConfig(kd, trimEnd, minOverlap);
+		
+		if(kd.kernel.align(kd.result, kd.read.data(), kd.read.size(), kd.query.data(), kd.query.size(), kc, true)){
+			setKernelResults(a, kd.result, read, query, kd.query);
+		}
+		else{
+			// scores might exceed range of kernel
+			
+			TAlign align;
+			a.score = alignSeqan(align, read, query, trimEnd);
+			
+			setAlignResults(a, align);
+		}
+	}
+	
+	
+	// transfer alignment view of kernel to results
+	
+	void setKernelResults(TAlignResults &a, const flexbar::KernelResult &r, const TSeqStr &read, const TSeqStr &query, const std::vector<int16_t> &queryCodes){
+		
+		using namespace std;
+		using namespace seqan;
+		using namespace flexbar;
+		
+		a.score      = r.score;
+		a.startPosS  = r.startPosS;
+		a.startPosA  = r.startPosA;
+		a.endPosS    = r.endPosS;
+		a.endPosA    = r.endPosA;
+		a.mismatches = r.mismatches;
+		a.gapsR      = r.gapsR;
+		a.gapsA      = r.gapsA;
+		
+		a.startPos = (a.startPosA > a.startPosS) ? a.startPosA : a.startPosS;
+		a.endPos   = (a.endPosA   > a.endPosS)   ? a.endPosS   : a.endPosA;
+		
+		if(m_umiTags){
+			a.umiTag = "";
 			
-			if(trimEnd == RIGHT || trimEnd == RTAIL){
+			for(unsigned int c = 0, s = 0, q = 0; c < r.view.size(); ++c){
 				
-				AlignConfig<true, false, true, true> ac;
-				alignments.ascores = globalAlignment(alignments.aset, m_scoreMatrix, ac);
-			}
-			else if(trimEnd == LEFT || trimEnd == LTAIL){
+				if(a.startPos <= (int) c && (int) c < a.endPos && r.view[c] == 'M' && queryCodes[q] == KERNEL_CODE_N)
+					append(a.umiTag, (TChar) read[s]);
 				
-				AlignConfig<true, true, false, true> ac;
-				alignments.ascores = globalAlignment(alignments.aset, m_scoreMatrix, ac);
+				if(r.view[c] != 'Q') ++s;
+				if(r.view[c] != 'R') ++q;
 			}
-			else{
-				AlignConfig<true, true, true, true> ac;
-				alignments.ascores = globalAlignment(alignments.aset, m_scoreMatrix, ac);
+		}
+		
+		if(m_log != NONE){
+			
+			TAlign align;
+			resize(rows(align), 2);
+			
+			assignSource(row(align, 0), read);
+			assignSource(row(align, 1), query);
+			
+			for(unsigned int c = 0; c < r.view.size(); ++c){
+				     if(r.view[c] == 'Q') insertGap(row(align, 0), c);
+				else if(r.view[c] == 'R') insertGap(row(align, 1), c);
 			}
+			
+			stringstream s;
+			s << align;
+			a.alString = s.str();
 		}
+	}
+	
+	
+	int alignSeqan(flexbar::TAlign &align, const TSeqStr &read, const TSeqStr &query, const flexbar::TrimEnd trimEnd){
 		
-		TAlign &align = alignments.aset[idxAl];
-		a.score       = alignments.ascores[idxAl];
+		using namespace seqan;
+		using namespace flexbar;
+		
+		resize(rows(align), 2);
+		
+		assignSource(row(align, 0), read);
+		assignSource(row(align, 1), query);
+		
+		if(trimEnd == RIGHT || trimEnd == RTAIL){
+			
+			AlignConfig<true, false, true, true> ac;
+			return globalAlignment(align, m_scoreMatrix, ac);
+		}
+		else if(trimEnd == LEFT || trimEnd == LTAIL){
+			
+			AlignConfig<true, true, false, true> ac;
+			return globalAlignment(align, m_scoreMatrix, ac);
+		}
+		else{
+			AlignConfig<true, true, true, true> ac;
+			return globalAlignment(align, m_scoreMatrix, ac);
+		}
+	}
+	
+	
+	void setAlignResults(TAlignResults &a, flexbar::TAlign &align){
+		
+		using namespace std;
+		using namespace seqan;
+		using namespace flexbar;
 		
 		// cout << "Score: " << a.score << endl;
 		// cout << "Align: " << align << endl;
@@ -139,6 +291,80 @@ public:
 	}
 	
 	
+	// unique and valid ungapped overlap at read end, gapped alignment otherwise
+	
+	bool alignUngapped(KernelData &kd, const flexbar::TrimEnd trimEnd, const int minOverlap){
+		
+		using namespace flexbar;
+		
+		if(! m_ungapped || (trimEnd != RIGHT && trimEnd != RTAIL)) return false;
+		
+		return kd.ungapped.align(kd.result, kd.read.data(), kd.read.size(), kd.query.data(), kd.query.size(), m_errorRate, minOverlap);
+	}
+	
+	
+	flexbar::KernelConfig getKernelConfig(const KernelData &kd, const flexbar::TrimEnd trimEnd, const int minOverlap){
+		
+		using namespace flexbar;
+		
+		KernelConfig kc(true, true, true, true);
+		
+		     if(trimEnd == RIGHT || trimEnd == RTAIL) kc.left  = false;
+		else if(trimEnd == LEFT  || trimEnd == LTAIL) kc.right = false;
+		
+		if(m_banded && minOverlap > 0) setBand(kc, kd.read.size(), kd.query.size(), trimEnd, minOverlap);
+		
+		return kc;
+	}
+	
+	
+	// Valid alignments in right and left modes contain at most e gaps, which limits
+	// the diagonals k = j - i of the read position j and query position i on their
+	// path by read length n, query length m and min-overlap. Band is not used if
+	// it would cover most cells anyway.
+	
+	void setBand(flexbar::KernelConfig &kc, const int n, const int m, const flexbar::TrimEnd trimEnd, const int minOverlap){
+		
+		using namespace flexbar;
+		
+		const int e = static_cast<int>(m_errorRate * std::min(n, m) / (1 - m_errorRate)) + 1;
+		
+		int low, high;
+		
+		if(trimEnd == RIGHT || trimEnd == RTAIL){
+			low  = -e;
+			high = n - minOverlap + 3 * e;
+		}
+		else if(trimEnd == LEFT || trimEnd == LTAIL){
+			low  = minOverlap - m - 3 * e;
+			high = n - m + e;
+		}
+		else return;
+		
+		long bandCells = 0;
+		
+		for(int i = 1; i <= m; ++i){
+			int cells = std::min(n, i + high) - std::max(1, i + low) + 1;
+			if(cells > 0) bandCells += cells;
+		}
+		
+		if(bandCells * 4 < 3L * n * m){
+			kc.bandLow  = low;
+			kc.bandHigh = high;
+		}
+	}
+	
+	
+	template <typename TSeq>
+	static void assignCodes(std::vector<int16_t> &codes, const TSeq &seq){
+		
+		codes.resize(seqan::length(seq));
+		
+		for(unsigned int i = 0; i < codes.size(); ++i)
+			codes[i] = seqan::ordValue(seq[i]);
+	}
+	
+	
 	void printScoreMatrix(TScoreMatrix &scoreMatrix){
 		
 		using namespace std;
@@ -0,0 +1,156 @@
+// SeqAlignAlgoMyers.h
+
+#ifndef FLEXBAR_SEQALIGNALGOMYERS_H
+#define FLEXBAR_SEQALIGNALGOMYERS_H
+
+#include <map>
+
+#include "SeqAlignAlgo.h"
+
+
+// Edit distance based alignment with bit-parallel search in right and left
+// modes, queries longer than word size, ANY mode and relaxed region use DP.
+
+template <typename TSeqStr>
+class SeqAlignAlgoMyers {
+
+private:
+	
+	typedef AlignResults<TSeqStr> TAlignResults;
+	
+	// kernel alignment of a read and query pair, includes traceback
+	
+	struct PairResult {
+		
+		bool isAligned;
+		flexbar::TrimEnd trimEnd;
+		int minOverlap;
+		
+		flexbar::KernelResult result;
+		std::vector<int16_t> read, query;
+		
+		PairResult() : isAligned(false), trimEnd(flexbar::ANY), minOverlap(0){}
+	};
+	
+	typedef std::map<std::pair<const TSeqStr*, const TSeqStr*>, PairResult> TPairResults;
+	
+	struct KernelData {
+		
+		SeqAlignMyersKernel kernel;
+		PairResult current;
+		
+		// results of score pass, reused for traceback of best candidates
+		TPairResults scored;
+		std::vector<int16_t> read, query;
+		
+		KernelData(const SeqAlignMyersKernel &k) : kernel(k){}
+	};
+	
+	const bool m_strictRegion;
+	const float m_errorRate;
+	
+	SeqAlignAlgo<TSeqStr> m_dp;
+	tbb::enumerable_thread_specific<KernelData> m_kernelData;
+	
+	
+	bool useKernel(const flexbar::TrimEnd trimEnd) const {
+		return trimEnd != flexbar::ANY && m_strictRegion;
+	}
+	
+	bool alignKernel(KernelData &kd, PairResult &pr, const TSeqStr &read, const TSeqStr &query, const flexbar::TrimEnd trimEnd, const int minOverlap){
+		
+		using namespace flexbar;
+		
+		m_dp.assignCodes(pr.read,  read);
+		m_dp.assignCodes(pr.query, query);
+		
+		const bool leftEnd = (trimEnd == LEFT || trimEnd == LTAIL);
+		
+		pr.trimEnd    = trimEnd;
+		pr.minOverlap = minOverlap;
+		pr.isAligned  = kd.kernel.align(pr.result, pr.read.data(), pr.read.size(), pr.query.data(), pr.query.size(), leftEnd, m_errorRate, minOverlap);
+		
+		return pr.isAligned;
+	}
+	
+	// scored result is valid if read and query at same objects did not change
+	
+	const PairResult* findScored(KernelData &kd, const TSeqStr &read, const TSeqStr &query, const flexbar::TrimEnd trimEnd, const int minOverlap){
+		
+		typename TPairResults::const_iterator it = kd.scored.find(std::make_pair(&read, &query));
+		
+		if(it == kd.scored.end()) return NULL;
+		
+		const PairResult &pr = it->second;
+		
+		if(! pr.isAligned || pr.trimEnd != trimEnd || pr.minOverlap != minOverlap) return NULL;
+		
+		m_dp.assignCodes(kd.read,  read);
+		m_dp.assignCodes(kd.query, query);
+		
+		if(kd.read != pr.read || kd.query != pr.query) return NULL;
+		
+		return &pr;
+	}
+	
+public:
+	
+	SeqAlignAlgoMyers(const Options &o, const int match, const int mismatch, const int gapCost, const bool isAdapterRm):
+			m_strictRegion(! o.relaxRegion),
+			m_errorRate(isAdapterRm ? o.a_errorRate : o.b_errorRate),
+			m_dp(o, match, mismatch, gapCost, isAdapterRm),
+			m_kernelData(KernelData(SeqAlignMyersKernel(match, mismatch, gapCost, isAdapterRm))){
+	};
+	
+	
+	void alignGlobal(TAlignResults &a, flexbar::Alignments &alignments, flexbar::ComputeCycle &cycle, const unsigned int idxAl, const flexbar::TrimEnd trimEnd, const int minOverlap = 0){
+		
+		using namespace seqan;
+		using namespace flexbar;
+		
+		if(cycle == COMPUTE) cycle = RESULTS;
+		
+		TAlign &align = alignments.aset[idxAl];
+		
+		alignTraceback(a, source(row(align, 0)), source(row(align, 1)), trimEnd, minOverlap);
+	}
+	
+	
+	// score is known after traceback of best hit
+	
+	int alignScore(const TSeqStr &read, const TSeqStr &query, const flexbar::TrimEnd trimEnd, const int minOverlap){
+		
+		if(! useKernel(trimEnd)) return m_dp.alignScore(read, query, trimEnd, minOverlap);
+		
+		KernelData &kd = m_kernelData.local();
+		
+		// candidate objects are reused per read, bound entries for new ones
+		if(kd.scored.size() > 4096) kd.scored.clear();
+		
+		PairResult &pr = kd.scored[std::make_pair(&read, &query)];
+		
+		if(alignKernel(kd, pr, read, query, trimEnd, minOverlap)) return pr.result.score;
+		else return m_dp.alignScore(read, query, trimEnd, minOverlap);
+	}
+	
+	
+	void alignTraceback(TAlignResults &a, const TSeqStr &read, const TSeqStr &query, const flexbar::TrimEnd trimEnd, const int minOverlap){
+		
+		if(! useKernel(trimEnd)){
+			m_dp.alignTraceback(a, read, query, trimEnd, minOverlap);
+			return;
+		}
+		
+		KernelData &kd = m_kernelData.local();
+		
+		const PairResult *pr = findScored(kd, read, query, trimEnd, minOverlap);
+		
+		if(pr == NULL && alignKernel(kd, kd.current, read, query, trimEnd, minOverlap)) pr = &kd.current;
+		
+		if(pr != NULL) m_dp.setKernelResults(a, pr->result, read, query, pr->query);
+		else           m_dp.alignTraceback(a, read, query, trimEnd, minOverlap);
+	}
+};
+
+
+#endif
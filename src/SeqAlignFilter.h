@@ -0,0 +1,226 @@
+// SeqAlignFilter.h
+
+#ifndef FLEXBAR_SEQALIGNFILTER_H
+#define FLEXBAR_SEQALIGNFILTER_H
+
+#include "SeqAlignKernel.h"
+
+
+// Prefilter that rules out reads without valid alignment to a query before any
+// alignment is computed. In right and left trim-end modes with strict region, a
+// valid alignment either contains the whole query or overlaps the read end. A
+// query of length m with at most e errors contains e + 1 disjoint k-mers, so one
+// of them is found exactly in the read if m >= k * (e + 1). Overlaps at the read
+// end are checked by edit distance of each query prefix to the read suffix.
+// All queries share one k-mer index, so each read is scanned once to find the
+// queries with seeds.
+
+class SeqAlignFilter {
+
+private:
+	
+	const float m_errorRate;
+	const bool m_isAdapterRm;
+	
+	int m_k;
+	
+	std::vector<std::vector<int16_t> > m_queries;
+	std::vector<bool> m_eligible;
+	std::vector<int> m_maxErrors;
+	
+	// presence bits of k-mers and sorted pairs of k-mer and query index
+	std::vector<uint64_t> m_kmers;
+	std::vector<std::pair<uint32_t, unsigned int> > m_index;
+	
+	
+	// max number of errors e <= errorRate * (length + e) for each length
+	
+	void setMaxErrors(const int maxLength){
+		
+		m_maxErrors.resize(maxLength + 1);
+		
+		for(int l = 0, e = 0; l <= maxLength; ++l){
+			while(static_cast<float>(e + 1) <= m_errorRate * (l + e + 1)) ++e;
+			m_maxErrors[l] = e;
+		}
+	}
+	
+	
+	bool hasN(const std::vector<int16_t> &seq) const {
+		
+		for(unsigned int i = 0; i < seq.size(); ++i)
+			if(seq[i] > 3) return true;
+		
+		return false;
+	}
+	
+	
+	void setKmers(const std::vector<int16_t> &seq, const unsigned int q){
+		
+		const uint32_t mask = (1u << (2 * m_k)) - 1;
+		
+		uint32_t kmer = 0;
+		
+		for(int i = 0; i < (int) seq.size(); ++i){
+			kmer = ((kmer << 2) | seq[i]) & mask;
+			
+			if(i + 1 >= m_k){
+				m_kmers[kmer >> 6] |= 1ull << (kmer & 63);
+				m_index.push_back(std::make_pair(kmer, q));
+			}
+		}
+	}
+	
+public:
+	
+	SeqAlignFilter(const float errorRate, const bool isAdapterRm) :
+		m_errorRate(errorRate),
+		m_isAdapterRm(isAdapterRm),
+		m_k(0){
+	};
+	
+	
+	void addQuery(const std::vector<int16_t> &query){
+		m_queries.push_back(query);
+	}
+	
+	
+	// choose k by pigeonhole principle for shortest query, shorter k-mers
+	// would be found in most reads by chance
+	
+	void build(){
+		
+		const int maxK = 12, minK = 6;
+		
+		m_k = 0;
+		
+		if(m_errorRate >= 0.5) return;
+		
+		m_k = maxK;
+		
+		setMaxErrors(128);
+		
+		m_eligible.assign(m_queries.size(), false);
+		
+		bool eligible = false;
+		
+		for(unsigned int i = 0; i < m_queries.size(); ++i){
+			
+			const int m = m_queries[i].size();
+			
+			if(m < 1 || m > 64 || hasN(m_queries[i])) continue;
+			
+			m_eligible[i] = true;
+			eligible      = true;
+			
+			m_k = std::min(m_k, m / (m_maxErrors[m] + 1));
+		}
+		
+		if(m_k < minK || ! eligible){
+			m_k = 0;
+			m_eligible.assign(m_queries.size(), false);
+			return;
+		}
+		
+		m_kmers.assign((1ul << (2 * m_k)) / 64 + 1, 0);
+		
+		for(unsigned int i = 0; i < m_queries.size(); ++i)
+			if(m_eligible[i]) setKmers(m_queries[i], i);
+		
+		std::sort(m_index.begin(), m_index.end());
+		m_index.erase(std::unique(m_index.begin(), m_index.end()), m_index.end());
+	}
+	
+	
+	bool isEligible(const unsigned int q) const {
+		return m_k > 0 && m_eligible[q];
+	}
+	
+	
+	// marks queries with a k-mer in the read, all queries if read contains N
+	// that matches query positions
+	
+	void findSeeds(std::vector<char> &seeds, const int16_t *read, const int n) const {
+		
+		const uint32_t mask = (1u << (2 * m_k)) - 1;
+		
+		seeds.assign(m_queries.size(), 0);
+		
+		uint32_t kmer = 0;
+		int valid = 0;
+		
+		for(int j = 0; j < n; ++j){
+			
+			if(read[j] > 3){
+				if(m_isAdapterRm){
+					seeds.assign(m_queries.size(), 1);
+					return;
+				}
+				valid = 0;
+				continue;
+			}
+			
+			kmer = ((kmer << 2) | read[j]) & mask;
+			
+			if(++valid >= m_k && (m_kmers[kmer >> 6] >> (kmer & 63)) & 1){
+				
+				std::vector<std::pair<uint32_t, unsigned int> >::const_iterator it;
+				it = std::lower_bound(m_index.begin(), m_index.end(), std::make_pair(kmer, 0u));
+				
+				for(; it != m_index.end() && it->first == kmer; ++it) seeds[it->second] = 1;
+			}
+		}
+	}
+	
+	
+	// whether a prefix of query q aligns to a suffix of the read within error rate,
+	// or a suffix of q to a read prefix in case of leftEnd, computed by bit-parallel
+	// edit distance for all query prefixes at last read position
+	
+	bool hasTerminalOverlap(const unsigned int q, const int16_t *read, const int n, const bool leftEnd, const int minOverlap) const {
+		
+		const std::vector<int16_t> &query = m_queries[q];
+		const int m = query.size();
+		
+		const int w = std::min(n, m + m_maxErrors[m]);
+		
+		uint64_t peq[5] = { 0, 0, 0, 0, 0 };
+		
+		for(int i = 0; i < m; ++i){
+			int c = leftEnd ? query[m - 1 - i] : query[i];
+			peq[c] |= 1ull << i;
+		}
+		
+		uint64_t pv = ~0ull, mv = 0;
+		
+		for(int x = 0; x < w; ++x){
+			
+			const int16_t c = leftEnd ? read[w - 1 - x] : read[n - w + x];
+			
+			const uint64_t eq = peq[c];
+			const uint64_t xv = eq | mv;
+			const uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+			
+			uint64_t ph = mv | ~(xh | pv);
+			uint64_t mh = pv & xh;
+			
+			ph <<= 1;
+			mh <<= 1;
+			
+			pv = mh | ~(xv | ph);
+			mv = ph & xv;
+		}
+		
+		for(int p = 1, d = 0; p <= m; ++p){
+			
+			if((pv >> (p - 1)) & 1) ++d;
+			if((mv >> (p - 1)) & 1) --d;
+			
+			if(d <= m_maxErrors[p] && p + m_maxErrors[p] >= minOverlap) return true;
+		}
+		return false;
+	}
+};
+
+
+#endif
@@ -0,0 +1,687 @@
+// SeqAlignKernel.h
+
+#ifndef FLEXBAR_SEQALIGNKERNEL_H
+#define FLEXBAR_SEQALIGNKERNEL_H
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+
+#if defined(__AVX2__) || defined(__SSE4_1__)
+	#include <immintrin.h>
+#endif
+
+
+// Semi-global alignment kernel with linear gap costs for read and query codes
+// (A=0, C=1, G=2, T=3, N=4). Cells are computed along anti-diagonals d = i + j,
+// where i indexes the query and j the read. Each anti-diagonal is stored as a
+// vector indexed by query position, so all neighbours and substitution scores
+// of a lane block are available by unaligned loads without lane shifts.
+
+namespace flexbar{
+
+#if defined(__AVX2__)
+	
+	typedef __m256i TSimdVec;
+	const int SIMD_LANES = 16;
+	
+	inline TSimdVec simdSet(const int16_t x){ return _mm256_set1_epi16(x); }
+	inline TSimdVec simdLoad(const int16_t *p){ return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+	inline void simdStore(int16_t *p, const TSimdVec &v){ _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v); }
+	inline TSimdVec simdAdds(const TSimdVec &a, const TSimdVec &b){ return _mm256_adds_epi16(a, b); }
+	inline TSimdVec simdMax(const TSimdVec &a, const TSimdVec &b){ return _mm256_max_epi16(a, b); }
+	inline TSimdVec simdEq(const TSimdVec &a, const TSimdVec &b){ return _mm256_cmpeq_epi16(a, b); }
+	inline TSimdVec simdOr(const TSimdVec &a, const TSimdVec &b){ return _mm256_or_si256(a, b); }
+	inline TSimdVec simdBlend(const TSimdVec &a, const TSimdVec &b, const TSimdVec &mask){ return _mm256_blendv_epi8(a, b, mask); }
+
+#elif defined(__SSE4_1__)
+	
+	typedef __m128i TSimdVec;
+	const int SIMD_LANES = 8;
+	
+	inline TSimdVec simdSet(const int16_t x){ return _mm_set1_epi16(x); }
+	inline TSimdVec simdLoad(const int16_t *p){ return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+	inline void simdStore(int16_t *p, const TSimdVec &v){ _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v); }
+	inline TSimdVec simdAdds(const TSimdVec &a, const TSimdVec &b){ return _mm_adds_epi16(a, b); }
+	inline TSimdVec simdMax(const TSimdVec &a, const TSimdVec &b){ return _mm_max_epi16(a, b); }
+	inline TSimdVec simdEq(const TSimdVec &a, const TSimdVec &b){ return _mm_cmpeq_epi16(a, b); }
+	inline TSimdVec simdOr(const TSimdVec &a, const TSimdVec &b){ return _mm_or_si128(a, b); }
+	inline TSimdVec simdBlend(const TSimdVec &a, const TSimdVec &b, const TSimdVec &mask){ return _mm_blendv_epi8(a, b, mask); }
+
+#else
+	
+	typedef int16_t TSimdVec;
+	const int SIMD_LANES = 1;
+	
+	inline TSimdVec simdSet(const int16_t x){ return x; }
+	inline TSimdVec simdLoad(const int16_t *p){ return *p; }
+	inline void simdStore(int16_t *p, const TSimdVec &v){ *p = v; }
+	inline TSimdVec simdAdds(const TSimdVec &a, const TSimdVec &b){ return std::max(-32768, std::min(32767, a + b)); }
+	inline TSimdVec simdMax(const TSimdVec &a, const TSimdVec &b){ return std::max(a, b); }
+	inline TSimdVec simdEq(const TSimdVec &a, const TSimdVec &b){ return (a == b) ? -1 : 0; }
+	inline TSimdVec simdOr(const TSimdVec &a, const TSimdVec &b){ return a | b; }
+	inline TSimdVec simdBlend(const TSimdVec &a, const TSimdVec &b, const TSimdVec &mask){ return mask ? b : a; }
+
+#endif
+	
+	const int16_t KERNEL_NEG       = -30000;
+	const int     KERNEL_MAX_SCORE =  14000;
+	
+	const int16_t KERNEL_CODE_N = 4;
+	
+	
+	// free end gaps, corresponds to seqan AlignConfig<top, left, right, bottom>
+	// and optional band of allowed diagonals k = j - i
+	
+	struct KernelConfig {
+		
+		bool top, left, right, bottom;
+		int bandLow, bandHigh;
+		
+		KernelConfig(const bool t, const bool l, const bool r, const bool b) :
+			top(t), left(l), right(r), bottom(b),
+			bandLow(std::numeric_limits<int>::min() / 2),
+			bandHigh(std::numeric_limits<int>::max() / 2){
+		}
+	};
+	
+	
+	// view columns of alignment: 'M' read and query, 'R' read only, 'Q' query only
+	
+	struct KernelResult {
+		
+		int score, mismatches, gapsR, gapsA;
+		int startPosS, startPosA, endPosS, endPosA;
+		
+		std::string view;
+	};
+	
+	
+	inline bool kernelMatch(const int16_t r, const int16_t q, const bool isAdapterRm){
+		return r == q || q == KERNEL_CODE_N || (r == KERNEL_CODE_N && isAdapterRm);
+	}
+	
+	
+	// positions, mismatches and gaps within overlap of alignment view
+	
+	inline void evaluateView(KernelResult &res, const int16_t *read, const int16_t *query, const bool isAdapterRm){
+		
+		const std::string &view = res.view;
+		
+		int firstR = -1, lastR = -1, firstQ = -1, lastQ = -1;
+		
+		for(int c = 0; c < (int) view.size(); ++c){
+			
+			if(view[c] != 'Q'){
+				if(firstR < 0) firstR = c;
+				lastR = c;
+			}
+			if(view[c] != 'R'){
+				if(firstQ < 0) firstQ = c;
+				lastQ = c;
+			}
+		}
+		
+		res.startPosS = firstR;
+		res.startPosA = firstQ;
+		res.endPosS   = lastR + 1;
+		res.endPosA   = lastQ + 1;
+		
+		const int startPos = std::max(res.startPosS, res.startPosA);
+		const int endPos   = std::min(res.endPosS,   res.endPosA);
+		
+		res.mismatches = 0;
+		res.gapsR      = 0;
+		res.gapsA      = 0;
+		
+		int r = 0, q = 0;
+		
+		for(int c = 0; c < (int) view.size(); ++c){
+			
+			if(startPos <= c && c < endPos){
+				     if(view[c] == 'Q')                                    ++res.gapsR;
+				else if(view[c] == 'R')                                    ++res.gapsA;
+				else if(! kernelMatch(read[r], query[q], isAdapterRm))     ++res.mismatches;
+			}
+			if(view[c] != 'Q') ++r;
+			if(view[c] != 'R') ++q;
+		}
+	}
+}
+
+
+class SeqAlignKernel {
+
+private:
+	
+	const int16_t m_match, m_mismatch, m_gap;
+	const bool m_isAdapterRm;
+	
+	int m_n, m_m, m_stride;
+	bool m_traceback;
+	
+	flexbar::KernelConfig m_cfg;
+	
+	std::vector<int16_t> m_rev, m_query, m_matrix;
+	std::vector<int> m_low, m_high, m_lastRow, m_lastCol;
+	
+	std::string m_path;
+	
+	
+	static int floorHalf(const int x){
+		return (x >= 0) ? x / 2 : -((1 - x) / 2);
+	}
+	
+	static int ceilHalf(const int x){
+		return -floorHalf(-x);
+	}
+	
+	int16_t* diagonal(const int d){
+		return &m_matrix[(m_traceback ? d : d % 3) * m_stride + flexbar::SIMD_LANES];
+	}
+	
+	int subScore(const int16_t r, const int16_t q) const {
+		return flexbar::kernelMatch(r, q, m_isAdapterRm) ? m_match : m_mismatch;
+	}
+	
+	int cell(const flexbar::KernelConfig &cfg, const int i, const int d){
+		
+		if(i == 0 && d <= m_n) return cfg.top  ? 0 : d * m_gap;
+		if(i == d && d <= m_m) return cfg.left ? 0 : d * m_gap;
+		
+		if(m_low[d] <= i && i <= m_high[d]) return diagonal(d)[i];
+		
+		return flexbar::KERNEL_NEG;
+	}
+	
+	
+	void computeDiagonal(const flexbar::KernelConfig &cfg, const int d, const flexbar::TSimdVec *v){
+		
+		using namespace flexbar;
+		
+		int16_t *r0 = diagonal(d);
+		
+		int lo = std::max(std::max(1, d - m_n), ceilHalf(d - cfg.bandHigh));
+		int hi = std::min(std::min(m_m, d - 1), floorHalf(d - cfg.bandLow));
+		
+		m_low[d]  = lo;
+		m_high[d] = hi;
+		
+		int i = lo;
+		
+		if(lo <= hi){
+			
+			const int16_t *r1 = diagonal(d - 1);
+			const int16_t *r2 = diagonal(d - 2);
+			
+			const int16_t *rev = m_rev.data() + (m_n - d);
+			
+			for(; i <= hi; i += SIMD_LANES){
+				
+				TSimdVec q = simdLoad(&m_query[i - 1]);
+				TSimdVec r = simdLoad(&rev[i]);
+				
+				TSimdVec eq = simdOr(simdOr(simdEq(q, r), simdEq(q, v[0])), simdEq(r, v[1]));
+				
+				TSimdVec diag = simdAdds(simdLoad(&r2[i - 1]), simdBlend(v[3], v[2], eq));
+				TSimdVec up   = simdAdds(simdLoad(&r1[i - 1]), v[4]);
+				TSimdVec left = simdAdds(simdLoad(&r1[i]),     v[4]);
+				
+				simdStore(&r0[i], simdMax(diag, simdMax(up, left)));
+			}
+		}
+		
+		// cells next to computed ones are out of matrix or band
+		
+		for(int k = std::max(hi + 1, -1); k <= std::min(std::max(i - 1, hi + 1), m_m + 1); ++k) r0[k] = KERNEL_NEG;
+		if(lo - 1 >= -1 && lo - 1 <= m_m + 1) r0[lo - 1] = KERNEL_NEG;
+		
+		if(d <= m_n) r0[0] = cfg.top  ? 0 : d * m_gap;
+		if(d <= m_m) r0[d] = cfg.left ? 0 : d * m_gap;
+		
+		// end cells in last row and last column
+		
+		if(d >= m_m && d - m_m <= m_n) m_lastRow[d - m_m] = cell(cfg, m_m, d);
+		if(d >= m_n && d - m_n <= m_m) m_lastCol[d - m_n] = cell(cfg, d - m_n, d);
+	}
+	
+	
+	void traceback(flexbar::KernelResult &res, const int16_t *read, const int16_t *query, int i, int j){
+		
+		const int ie = i, je = j;
+		
+		m_path.clear();
+		
+		// prefer diagonal over vertical over horizontal step
+		
+		while(i > 0 && j > 0){
+			
+			const int d = i + j;
+			const int v = cell(m_cfg, i, d);
+			
+			if(cell(m_cfg, i - 1, d - 2) + subScore(read[j - 1], query[i - 1]) == v){
+				m_path += 'M';
+				--i; --j;
+			}
+			else if(cell(m_cfg, i - 1, d - 1) + m_gap == v){
+				m_path += 'Q';
+				--i;
+			}
+			else{
+				m_path += 'R';
+				--j;
+			}
+		}
+		
+		std::string &view = res.view;
+		
+		view.assign(j, 'R');
+		view.append(i, 'Q');
+		view.append(m_path.rbegin(), m_path.rend());
+		view.append(m_n - je, 'R');
+		view.append(m_m - ie, 'Q');
+		
+		flexbar::evaluateView(res, read, query, m_isAdapterRm);
+	}
+	
+public:
+	
+	SeqAlignKernel(const int match, const int mismatch, const int gapCost, const bool isAdapterRm) :
+		m_match(match),
+		m_mismatch(mismatch),
+		m_gap(gapCost),
+		m_isAdapterRm(isAdapterRm),
+		m_n(0),
+		m_m(0),
+		m_stride(0),
+		m_traceback(false),
+		m_cfg(true, true, true, true){
+	}
+	
+	
+	// returns false if scores could exceed 16 bit range
+	
+	bool align(flexbar::KernelResult &res, const int16_t *read, const int n, const int16_t *query, const int m, const flexbar::KernelConfig &cfg, const bool traceback){
+		
+		using namespace flexbar;
+		
+		const int maxAbs = std::max(std::max(std::abs(m_match), std::abs(m_mismatch)), std::abs(m_gap));
+		
+		if(n < 1 || m < 1 || (n + m + 1) * maxAbs > KERNEL_MAX_SCORE) return false;
+		
+		m_n = n;
+		m_m = m;
+		m_cfg = cfg;
+		m_traceback = traceback;
+		m_stride = m + 2 * SIMD_LANES + 2;
+		
+		// query code of lane i at index i - 1, reversed read code at n - d + i
+		
+		m_query.assign(m + SIMD_LANES, -3);
+		std::copy(query, query + m, m_query.begin());
+		
+		m_rev.assign(n + SIMD_LANES, -2);
+		std::reverse_copy(read, read + n, m_rev.begin());
+		
+		const int nDiag = n + m + 1;
+		
+		m_matrix.resize((traceback ? nDiag : 3) * m_stride);
+		m_low.resize(nDiag);
+		m_high.resize(nDiag);
+		m_lastRow.resize(n + 1);
+		m_lastCol.resize(m + 1);
+		
+		const TSimdVec v[5] = { simdSet(KERNEL_CODE_N), simdSet(m_isAdapterRm ? KERNEL_CODE_N : -1),
+		                        simdSet(m_match), simdSet(m_mismatch), simdSet(m_gap) };
+		
+		for(int d = 0; d < nDiag; ++d) computeDiagonal(cfg, d, v);
+		
+		// end cell in column-major order with first maximum, last row of
+		// preceding columns is checked before all cells of last column
+		
+		int score = std::numeric_limits<int>::min();
+		int ie = m, je = n;
+		
+		for(int j = 0; j < n; ++j){
+			if(cfg.bottom && m_lastRow[j] > score && m_lastRow[j] > KERNEL_NEG){
+				score = m_lastRow[j];
+				ie = m; je = j;
+			}
+		}
+		for(int i = 0; i <= m; ++i){
+			if((cfg.right || i == m) && m_lastCol[i] > score && m_lastCol[i] > KERNEL_NEG){
+				score = m_lastCol[i];
+				ie = i; je = n;
+			}
+		}
+		
+		res.score = score;
+		
+		if(traceback) this->traceback(res, read, query, ie, je);
+		
+		return true;
+	}
+};
+
+
+// Bit-parallel edit distance search of Myers with query in one 64-bit word.
+// Finds query occurrences in the read and query prefixes at the read end within
+// the error rate, alignments at the read start are searched on reversed codes.
+
+class SeqAlignMyersKernel {
+
+private:
+	
+	const int m_match, m_mismatch, m_gap;
+	const bool m_isAdapterRm;
+	
+	std::vector<int16_t> m_read, m_query;
+	std::vector<int> m_matrix;
+	
+	std::string m_path;
+	
+	
+	// unit cost traceback for query prefix of length qLen ending before read position rEnd
+	
+	void traceback(flexbar::KernelResult &res, const int16_t *read, const int n, const int16_t *query, const int m, const int qLen, const int rEnd, const int dist){
+		
+		using namespace flexbar;
+		
+		const int rStart = std::max(0, rEnd - qLen - dist);
+		const int w      = rEnd - rStart;
+		const int cols   = w + 1;
+		
+		m_matrix.resize((qLen + 1) * cols);
+		
+		for(int x = 0; x <= w; ++x) m_matrix[x] = 0;
+		
+		for(int i = 1; i <= qLen; ++i){
+			
+			int *h  = &m_matrix[i * cols];
+			int *h1 = h - cols;
+			
+			h[0] = i;
+			
+			for(int x = 1; x <= w; ++x){
+				int sub = h1[x - 1] + (kernelMatch(read[rStart + x - 1], query[i - 1], m_isAdapterRm) ? 0 : 1);
+				h[x] = std::min(sub, std::min(h1[x], h[x - 1]) + 1);
+			}
+		}
+		
+		m_path.clear();
+		
+		int i = qLen, x = w;
+		
+		while(i > 0){
+			
+			const int v = m_matrix[i * cols + x];
+			
+			if(x > 0 && m_matrix[(i - 1) * cols + x - 1] + (kernelMatch(read[rStart + x - 1], query[i - 1], m_isAdapterRm) ? 0 : 1) == v){
+				m_path += 'M';
+				--i; --x;
+			}
+			else if(x == 0 || m_matrix[(i - 1) * cols + x] + 1 == v){
+				m_path += 'Q';
+				--i;
+			}
+			else{
+				m_path += 'R';
+				--x;
+			}
+		}
+		
+		std::string &view = res.view;
+		
+		view.assign(rStart + x, 'R');
+		view.append(m_path.rbegin(), m_path.rend());
+		view.append(n - rEnd, 'R');
+		view.append(m - qLen, 'Q');
+	}
+	
+public:
+	
+	SeqAlignMyersKernel(const int match, const int mismatch, const int gapCost, const bool isAdapterRm) :
+		m_match(match),
+		m_mismatch(mismatch),
+		m_gap(gapCost),
+		m_isAdapterRm(isAdapterRm){
+	}
+	
+	
+	// returns false if query does not fit into word, score is minimal without hit
+	
+	bool align(flexbar::KernelResult &res, const int16_t *read, const int n, const int16_t *query, const int m, const bool leftEnd, const float errorRate, const int minOverlap){
+		
+		using namespace flexbar;
+		
+		typedef unsigned long long TWord;
+		
+		if(m < 1 || n < 1 || m > 64) return false;
+		
+		const int16_t *r = read, *q = query;
+		
+		if(leftEnd){
+			m_read.assign(read, read + n);
+			m_query.assign(query, query + m);
+			
+			std::reverse(m_read.begin(), m_read.end());
+			std::reverse(m_query.begin(), m_query.end());
+			
+			r = m_read.data();
+			q = m_query.data();
+		}
+		
+		const TWord mask = (m == 64) ? ~0ULL : (1ULL << m) - 1;
+		const TWord high = 1ULL << (m - 1);
+		
+		TWord peq[5] = { 0, 0, 0, 0, 0 };
+		
+		for(int i = 0; i < m; ++i){
+			if(q[i] == KERNEL_CODE_N) for(int c = 0; c < 5; ++c) peq[c] |= 1ULL << i;
+			else                      peq[q[i]] |= 1ULL << i;
+		}
+		if(m_isAdapterRm) peq[KERNEL_CODE_N] = mask;
+		
+		// candidate with best estimated score, ties resolved by leftmost start
+		
+		const int maxFull = static_cast<int>(errorRate * m);
+		
+		int bestEst = std::numeric_limits<int>::min(), bestStart = 0;
+		int bestLen = 0, bestEnd = 0, bestDist = 0;
+		
+		TWord pv = mask, mv = 0;
+		int dist = m;
+		
+		for(int j = 0; j < n; ++j){
+			
+			const TWord eq = peq[r[j]];
+			const TWord xv = eq | mv;
+			const TWord xh = (((eq & pv) + pv) ^ pv) | eq;
+			
+			TWord ph = mv | ~(xh | pv);
+			TWord mh = pv & xh;
+			
+			if(ph & high) ++dist;
+			if(mh & high) --dist;
+			
+			ph <<= 1;
+			mh <<= 1;
+			
+			pv = (mh | ~(xv | ph)) & mask;
+			mv = ph & xv;
+			
+			if(dist <= maxFull){
+				const int est = (m - dist) * m_match + dist * m_mismatch;
+				
+				if(est > bestEst){
+					bestEst  = est;
+					bestLen  = m;
+					bestEnd  = j + 1;
+					bestDist = dist;
+					bestStart = j + 1 - m;
+				}
+			}
+		}
+		
+		// query prefixes overlapping read end
+		
+		int d = 0;
+		
+		for(int i = 1; i < m; ++i){
+			
+			d += static_cast<int>((pv >> (i - 1)) & 1) - static_cast<int>((mv >> (i - 1)) & 1);
+			
+			if(i < minOverlap || d > static_cast<int>(errorRate * i)) continue;
+			
+			const int est   = (i - d) * m_match + d * m_mismatch;
+			const int start = n - i;
+			
+			if(est > bestEst || (est == bestEst && start < bestStart)){
+				bestEst  = est;
+				bestLen  = i;
+				bestEnd  = n;
+				bestDist = d;
+				bestStart = start;
+			}
+		}
+		
+		if(bestLen == 0){
+			res.score = std::numeric_limits<int>::min();
+			res.view  = "";
+			
+			res.startPosS = res.startPosA = res.endPosS = res.endPosA = 0;
+			res.mismatches = res.gapsR = res.gapsA = 0;
+			return true;
+		}
+		
+		traceback(res, r, n, q, m, bestLen, bestEnd, bestDist);
+		
+		if(leftEnd) std::reverse(res.view.begin(), res.view.end());
+		
+		evaluateView(res, read, query, m_isAdapterRm);
+		
+		const int overlap = std::min(res.endPosS, res.endPosA) - std::max(res.startPosS, res.startPosA);
+		const int gaps    = res.gapsR + res.gapsA;
+		
+		res.score = (overlap - res.mismatches - gaps) * m_match + res.mismatches * m_mismatch + gaps * m_gap;
+		
+		return true;
+	}
+};
+
+
+// Ungapped overlaps of query in one 64-bit word starting at each read position,
+// as in right trim-end mode with strict region. Codes are stored as two bit
+// planes and a mask for N, mismatches of a diagonal are counted by popcount.
+
+class SeqAlignUngappedKernel {
+
+private:
+	
+	const int m_match, m_mismatch;
+	const bool m_isAdapterRm;
+	
+	std::vector<uint64_t> m_lo, m_hi, m_n;
+	
+	
+	static uint64_t window(const std::vector<uint64_t> &w, const int p){
+		
+		const int b = p & 63;
+		
+		if(b == 0) return w[p >> 6];
+		else       return (w[p >> 6] >> b) | (w[(p >> 6) + 1] << (64 - b));
+	}
+	
+	
+	static void setPlanes(uint64_t *lo, uint64_t *hi, uint64_t *n, const int16_t *seq, const int len){
+		
+		for(int j = 0; j < len; ++j){
+			
+			const uint64_t bit = 1ull << (j & 63);
+			
+			if(seq[j] == flexbar::KERNEL_CODE_N) n[j >> 6] |= bit;
+			else{
+				if(seq[j] & 1) lo[j >> 6] |= bit;
+				if(seq[j] & 2) hi[j >> 6] |= bit;
+			}
+		}
+	}
+	
+public:
+	
+	SeqAlignUngappedKernel(const int match, const int mismatch, const bool isAdapterRm) :
+		m_match(match),
+		m_mismatch(mismatch),
+		m_isAdapterRm(isAdapterRm){
+	};
+	
+	
+	// best ungapped overlap, false if it is not valid within error rate and
+	// min-overlap or if another overlap has the same score
+	
+	bool align(flexbar::KernelResult &res, const int16_t *read, const int n, const int16_t *query, const int m, const float errorRate, const int minOverlap){
+		
+		using namespace flexbar;
+		
+		if(n < 1 || m < 1 || m > 64) return false;
+		
+		const int words = (n >> 6) + 2;
+		
+		m_lo.assign(words, 0);
+		m_hi.assign(words, 0);
+		m_n.assign(words, 0);
+		
+		setPlanes(&m_lo[0], &m_hi[0], &m_n[0], read, n);
+		
+		uint64_t qlo = 0, qhi = 0, qn = 0;
+		setPlanes(&qlo, &qhi, &qn, query, m);
+		
+		int best = std::numeric_limits<int>::min(), bestPos = -1, bestMm = 0, nBest = 0;
+		
+		for(int p = 0; p < n; ++p){
+			
+			const int len = std::min(m, n - p);
+			const uint64_t mask = (len == 64) ? ~0ull : (1ull << len) - 1;
+			
+			const uint64_t rn = window(m_n, p);
+			
+			uint64_t diff = (window(m_lo, p) ^ qlo) | (window(m_hi, p) ^ qhi);
+			
+			if(m_isAdapterRm) diff &= ~rn;
+			else              diff |=  rn;
+			
+			const int mm    = __builtin_popcountll(diff & ~qn & mask);
+			const int score = (len - mm) * m_match + mm * m_mismatch;
+			
+			if(score > best){
+				best    = score;
+				bestPos = p;
+				bestMm  = mm;
+				nBest   = 1;
+			}
+			else if(score == best) ++nBest;
+		}
+		
+		const int len = std::min(m, n - bestPos);
+		
+		if(nBest > 1 || len < minOverlap || static_cast<float>(bestMm) > errorRate * len) return false;
+		
+		res.view.assign(bestPos, 'R');
+		res.view.append(len, 'M');
+		
+		if(bestPos + len < n) res.view.append(n - bestPos - len, 'R');
+		else                  res.view.append(m - len, 'Q');
+		
+		evaluateView(res, read, query, m_isAdapterRm);
+		
+		res.score = best;
+		
+		return true;
+	}
+};
+
+
+#endif
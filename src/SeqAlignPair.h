@@ -20,7 +20,7 @@ private:
 	const float m_errorRate;
 	const unsigned int m_bundleSize;
 	
-	tbb::atomic<unsigned long> m_nPreShortReads, m_overlaps, m_modified;
+	std::atomic<unsigned long> m_nPreShortReads, m_overlaps, m_modified;
 	tbb::concurrent_vector<unsigned long> m_overlapLengths;
 	
 	std::ostream *m_out;
@@ -72,14 +72,14 @@ public:
 			
 			if(idxAl == 0) reserve(alignments.aset, m_bundleSize);
 			
-			TSeqStr rcSeq2 = seqRead2.seq;
+			TSeqStr seq = seqRead.seq, rcSeq2 = seqRead2.seq;
 			seqan::reverseComplement(rcSeq2);
 			
 			TAlign align;
 			appendValue(alignments.aset, align);
 			resize(rows(alignments.aset[idxAl]), 2);
 			
-			assignSource(row(alignments.aset[idxAl], 0), seqRead.seq);
+			assignSource(row(alignments.aset[idxAl], 0), seq);
 			assignSource(row(alignments.aset[idxAl], 1), rcSeq2);
 			
 			++idxAl;
@@ -107,10 +107,7 @@ public:
 				if(m_poMode == PONLY || (m_poMode == PSHORT && a.startPosS < m_aMinOverlap)){
 					
 					unsigned int rCutPos = readLength2 - a.startPosS;
-					erase(seqRead2.seq, rCutPos, readLength2);
-					
-					if(m_format == FASTQ)
-					erase(seqRead2.qual, rCutPos, readLength2);
+					seqRead2.keepPrefix(rCutPos);
 					
 					++m_modified;
 					
@@ -127,10 +124,7 @@ public:
 				if(m_poMode == PONLY || (m_poMode == PSHORT && (a.endPosS - a.endPosA) < m_aMinOverlap)){
 					
 					unsigned int rCutPos = readLength - (a.endPosS - a.endPosA);
-					erase(seqRead.seq, rCutPos, readLength);
-					
-					if(m_format == FASTQ)
-					erase(seqRead.qual, rCutPos, readLength);
+					seqRead.keepPrefix(rCutPos);
 					
 					++m_modified;
 					
@@ -3,8 +3,12 @@
 #ifndef FLEXBAR_SEQINPUT_H
 #define FLEXBAR_SEQINPUT_H
 
+#include <thread>
+#include <atomic>
 #include <seqan/seq_io.h>
+#include <tbb/concurrent_queue.h>
 #include "QualTrimming.h"
+#include "RawSeqFile.h"
 
 
 template <typename TSeqStr, typename TString>
@@ -13,12 +17,35 @@ class SeqInput {
 private:
 	
 	seqan::FlexbarReadsSeqFileIn seqFileIn;
+	RawSeqFile *m_raw;
 	const flexbar::QualTrimType m_qtrim;
 	const flexbar::FileFormat m_format;
 	
 	const bool m_preProcess, m_useStdin, m_qtrimPostRm, m_iupacInput;
 	const int m_maxUncalled, m_preTrimBegin, m_preTrimEnd, m_qtrimThresh, m_qtrimWinSize;
-	tbb::atomic<unsigned long> m_nrReads, m_nrChars, m_nLowPhred;
+	std::atomic<unsigned long> m_nrReads, m_nrChars, m_nLowPhred;
+	
+	// records read ahead in own thread, NULL marks end of file
+	std::thread m_reader;
+	std::atomic<bool> m_stop;
+	tbb::concurrent_bounded_queue<flexbar::SeqReadData* > m_queue;
+	
+	
+	void readAhead(const unsigned int nReads){
+		
+		using namespace flexbar;
+		
+		while(! m_stop){
+			SeqReadData *srd = new SeqReadData();
+			
+			if(loadSeqReads(*srd, nReads) == 0){
+				delete srd;
+				break;
+			}
+			m_queue.push(srd);
+		}
+		m_queue.push(NULL);
+	}
 	
 public:
 	
@@ -35,6 +62,8 @@ public:
 		m_qtrimPostRm(o.qtrimPostRm),
 		m_iupacInput(o.iupacInput),
 		m_format(o.format),
+		m_raw(NULL),
+		m_stop(false),
 		m_nrReads(0),
 		m_nrChars(0),
 		m_nLowPhred(0){
@@ -47,7 +76,38 @@ public:
 				exit(1);
 			}
 		}
-		else{
+		else if(checkFileCompression(filePath) == flexbar::UNCOMPRESSED){
+			m_raw = new RawSeqFile(m_iupacInput);
+			
+			// falls back to stream for files that can not be mapped, e.g. pipes
+			if(! m_raw->open(filePath)){
+				delete m_raw;
+				m_raw = NULL;
+			}
+		}
+	#if SEQAN_HAS_ZLIB
+		else if(checkFileCompression(filePath) == flexbar::GZ){
+			m_raw = new RawSeqFile(m_iupacInput);
+			
+			if(! m_raw->openGzip(filePath, o.gzipThreads)){
+				cerr << "\nERROR: Could not open file " << filePath << "\n" << endl;
+				exit(1);
+			}
+		}
+	#endif
+	#if FLEXBAR_HAS_ZSTD
+		else if(checkFileCompression(filePath) == flexbar::ZST){
+			m_raw = new RawSeqFile(m_iupacInput);
+			
+			// seqan does not read zst files
+			if(! m_raw->openZstd(filePath)){
+				cerr << "\nERROR: Could not open file " << filePath << "\n" << endl;
+				exit(1);
+			}
+		}
+	#endif
+		
+		if(! m_useStdin && m_raw == NULL){
 			if(! open(seqFileIn, filePath.c_str())){
 				cerr << "\nERROR: Could not open file " << filePath << "\n" << endl;
 				exit(1);
@@ -56,26 +116,81 @@ public:
 	};
 	
 	virtual ~SeqInput(){
-		close(seqFileIn);
+		
+		// read ahead records are discarded until end is marked
+		if(m_reader.joinable()){
+			m_stop = true;
+			
+			flexbar::SeqReadData *srd;
+			
+			while(true){
+				m_queue.pop(srd);
+				
+				if(srd == NULL) break;
+				delete srd;
+			}
+			m_reader.join();
+		}
+		
+		if(m_raw != NULL) delete m_raw;
+		else              close(seqFileIn);
 	};
 	
 	
-	// returns number of read SeqReads
-	unsigned int loadSeqReads(seqan::StringSet<bool> &uncalled, flexbar::TStrings &ids, flexbar::TSeqStrs &seqs, flexbar::TStrings &quals, const unsigned int nReads){
+	void startReadAhead(const unsigned int nReads){
+		
+		m_queue.set_capacity(4);
+		
+		m_reader = std::thread(&SeqInput::readAhead, this, nReads);
+	}
+	
+	
+	// replaces srd with next records from read-ahead queue if started, returns
+	// number of read SeqReads
+	unsigned int nextSeqReads(flexbar::SeqReadData* &srd, const unsigned int nReads){
+		
+		using namespace flexbar;
+		
+		if(m_reader.joinable()){
+			
+			SeqReadData *next;
+			m_queue.pop(next);
+			
+			if(next != NULL){
+				delete srd;
+				srd = next;
+				
+				return srd->nReads;
+			}
+			m_reader.join();
+		}
+		
+		return loadSeqReads(*srd, nReads);
+	}
+	
+	
+	// returns number of read SeqReads, raw records are parsed later
+	unsigned int loadSeqReads(flexbar::SeqReadData &srd, const unsigned int nReads){
 		
 		using namespace std;
 		using namespace flexbar;
 		
-		using seqan::prefix;
-		using seqan::suffix;
 		using seqan::length;
 		
 		try{
+			if(m_raw != NULL){
+				srd.nReads = m_raw->readBlock(srd.rawBegin, srd.rawEnd, srd.rawData, nReads, m_format == FASTQ);
+				return srd.nReads;
+			}
+			
 			if(! atEnd(seqFileIn)){
 				
-				reserve(ids,      nReads);
-				reserve(seqs,     nReads);
-				reserve(uncalled, nReads);
+				TStrings &ids   = srd.ids;
+				TSeqStrs &seqs  = srd.seqs;
+				TStrings &quals = srd.quals;
+				
+				reserve(ids,  nReads);
+				reserve(seqs, nReads);
 				
 				if(! m_iupacInput){
 					
@@ -103,59 +218,9 @@ public:
 					seqs = seqsIupac;
 				}
 				
-				for(unsigned int i = 0; i < length(ids); ++i){
-					
-					TString &id  =  ids[i];
-					TSeqStr &seq = seqs[i];
-					
-					if(length(id) < 1){
-						cerr << "\nERROR: Input read without name.\n" << endl;
-						close(seqFileIn);
-						exit(1);
-					}
-					if(length(seq) < 1){
-						cerr << "\nERROR: Input read without sequence.\n" << endl;
-						close(seqFileIn);
-						exit(1);
-					}
-					
-					m_nrChars += length(seq);
-					
-					appendValue(uncalled, isUncalledSequence(seq));
-					
-					if(m_preProcess){
-						
-						if(m_preTrimBegin > 0 && length(seq) > 1){
-							
-							int idx = m_preTrimBegin;
-							if(idx >= length(seq)) idx = length(seq) - 1;
-							
-							erase(seq, 0, idx);
-							
-							if(m_format == FASTQ)
-							erase(quals[i], 0, idx);
-						}
-						
-						if(m_preTrimEnd > 0 && length(seq) > 1){
-							
-							int idx = m_preTrimEnd;
-							if(idx >= length(seq)) idx = length(seq) - 1;
-							
-							seq = prefix(seq, length(seq) - idx);
-							
-							if(m_format == FASTQ)
-							quals[i] = prefix(quals[i], length(quals[i]) - idx);
-						}
-						
-						if(m_qtrim != QOFF && ! m_qtrimPostRm){
-							if(qualTrim(seq, quals[i], m_qtrim, m_qtrimThresh, m_qtrimWinSize)) ++m_nLowPhred;
-						}
-					}
-				}
-				
-				m_nrReads += length(ids);
+				srd.nReads = length(ids);
 				
-				return length(ids);
+				return srd.nReads;
 			}
 			
 			else return 0;  // end of file
@@ -168,21 +233,99 @@ public:
 	}
 	
 	
+	// parses raw records and applies pre-processing, called in parallel
+	void processSeqReads(flexbar::SeqReadData &srd){
+		
+		using namespace std;
+		using namespace flexbar;
+		
+		using seqan::prefix;
+		using seqan::suffix;
+		using seqan::length;
+		
+		TStrings &ids      = srd.ids;
+		TSeqStrs &seqs     = srd.seqs;
+		TStrings &quals    = srd.quals;
+		TBools   &uncalled = srd.uncalled;
+		
+		if(srd.rawBegin != NULL){
+			try{
+				const char *pos = srd.rawBegin;
+				m_raw->parseRecords(ids, seqs, quals, pos, srd.rawEnd, srd.nReads, m_format == FASTQ);
+			}
+			catch(seqan::Exception const &e){
+				cerr << "\nERROR: " << e.what() << "\nProgram execution aborted.\n" << endl;
+				exit(1);
+			}
+		}
+		
+		reserve(uncalled, length(ids));
+		
+		for(unsigned int i = 0; i < length(ids); ++i){
+			
+			TString &id  =  ids[i];
+			TSeqStr &seq = seqs[i];
+			
+			if(length(id) < 1){
+				cerr << "\nERROR: Input read without name.\n" << endl;
+				exit(1);
+			}
+			if(length(seq) < 1){
+				cerr << "\nERROR: Input read without sequence.\n" << endl;
+				exit(1);
+			}
+			
+			m_nrChars += length(seq);
+			
+			appendValue(uncalled, isUncalledSequence(seq));
+			
+			if(m_preProcess){
+				
+				if(m_preTrimBegin > 0 && length(seq) > 1){
+					
+					int idx = m_preTrimBegin;
+					if(idx >= length(seq)) idx = length(seq) - 1;
+					
+					erase(seq, 0, idx);
+					
+					if(m_format == FASTQ)
+					erase(quals[i], 0, idx);
+				}
+				
+				if(m_preTrimEnd > 0 && length(seq) > 1){
+					
+					int idx = m_preTrimEnd;
+					if(idx >= length(seq)) idx = length(seq) - 1;
+					
+					resize(seq, length(seq) - idx);
+					
+					if(m_format == FASTQ)
+					resize(quals[i], length(quals[i]) - idx);
+				}
+				
+				if(m_qtrim != QOFF && ! m_qtrimPostRm){
+					if(qualTrim(seq, quals[i], m_qtrim, m_qtrimThresh, m_qtrimWinSize)) ++m_nLowPhred;
+				}
+			}
+		}
+		
+		m_nrReads += length(ids);
+	}
+	
+	
 	// returns TRUE if read contains too many uncalled bases
 	bool isUncalledSequence(TSeqStr &seq){
 		
 		using namespace seqan;
 		
-		typename Iterator<TSeqStr>::Type it, itEnd;
+		typedef typename Value<TSeqStr>::Type TValue;
 		
-		it    = begin(seq);
-		itEnd = end(seq);
-		int n = 0;
+		static_assert(sizeof(TValue) == 1, "letters are stored as one byte codes");
+		
+		const unsigned char *b = reinterpret_cast<const unsigned char*>(begin(seq, Standard()));
+		
+		int n = flexbar::countByte(b, b + length(seq), ordValue(TValue('N')));
 		
-		while(it != itEnd){
-			 if(*it == 'N') n++;
-			 ++it;
-		}
 		return(n > m_maxUncalled);
 	}
 	
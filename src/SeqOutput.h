@@ -3,6 +3,9 @@
 #ifndef FLEXBAR_SEQOUTPUT_H
 #define FLEXBAR_SEQOUTPUT_H
 
+#include "BlockCompressor.h"
+#include "DemuxWriter.h"
+
 
 template <typename TSeqStr, typename TString>
 class SeqOutput {
@@ -12,18 +15,30 @@ private:
 	seqan::FlexbarReadsSeqFileOut seqFileOut;
 	std::string m_filePath;
 	
+	// compressed blocks of bundles are written to file
+	std::ofstream m_blockFile;
+	bool m_compressBlocks, m_finished;
+	
+	// shared writer of barcoded runs, file is created on first write
+	DemuxWriter *m_demux;
+	unsigned int m_demuxId;
+	
 	const TString m_tagStr;
 	const flexbar::FileFormat m_format;
 	const flexbar::CompressionType m_cmprsType;
 	const bool m_switch2Fasta, m_writeLenDist, m_useStdout;
 	const unsigned int m_minLength, m_cutLen_read;
+	const int m_zipLevel;
 	
-	tbb::atomic<unsigned long> m_countGood, m_countGoodChars;
-	tbb::concurrent_vector<unsigned long> m_lengthDist;
+	// index of buffer in read bundles
+	unsigned int m_bufferIdx;
+	
+	std::atomic<unsigned long> m_countGood, m_countGoodChars;
+	std::vector<std::atomic<unsigned long> > m_lengthDist;
 	
 public:
 	
-	SeqOutput(const std::string &filePath, const TString tagStr, const bool alwaysFile, const Options &o) :
+	SeqOutput(const std::string &filePath, const TString tagStr, const bool alwaysFile, const Options &o, DemuxWriter *demux = NULL) :
 		m_format(o.format),
 		m_switch2Fasta(o.switch2Fasta),
 		m_tagStr(tagStr),
@@ -32,8 +47,15 @@ public:
 		m_writeLenDist(o.writeLengthDist),
 		m_useStdout(o.useStdout && ! alwaysFile),
 		m_cmprsType(o.cmprsType),
+		m_zipLevel(o.zipLevel),
+		m_compressBlocks(false),
+		m_finished(false),
+		m_demux(NULL),
+		m_demuxId(0),
+		m_bufferIdx(0),
 		m_countGood(0),
-		m_countGoodChars(0){
+		m_countGoodChars(0),
+		m_lengthDist(flexbar::MAX_READLENGTH + 1){
 		
 		using namespace std;
 		using namespace flexbar;
@@ -48,8 +70,6 @@ public:
 		}
 		m_filePath += o.outCompression;
 		
-		m_lengthDist = tbb::concurrent_vector<unsigned long>(MAX_READLENGTH + 1, 0);
-		
 		if(m_useStdout){
 			
 			if(m_format == FASTA || m_switch2Fasta)
@@ -61,6 +81,25 @@ public:
 				exit(1);
 			}
 		}
+		else if(demux != NULL){
+			
+			m_demux   = demux;
+			m_demuxId = demux->addFile(m_filePath);
+			
+			m_compressBlocks = m_cmprsType != UNCOMPRESSED;
+		}
+		// records of bundles are compressed in blocks by the format stage
+		else if(m_cmprsType != UNCOMPRESSED){
+			
+			m_compressBlocks = true;
+			
+			m_blockFile.open(m_filePath.c_str(), ios::out | ios::binary);
+			
+			if(! m_blockFile.good()){
+				cerr << "\nERROR: Could not open file " << m_filePath << "\n" << endl;
+				exit(1);
+			}
+		}
 		else{
 			if(! open(seqFileOut, m_filePath.c_str())){
 				cerr << "\nERROR: Could not open file " << m_filePath << "\n" << endl;
@@ -71,10 +110,40 @@ public:
 	
 	
 	virtual ~SeqOutput(){
-		if(! m_useStdout) close(seqFileOut);
+		finish();
 	};
 	
 	
+	// closes file after pipeline, gz files end with empty block
+	
+	void finish(){
+		
+		using namespace std;
+		
+		if(m_finished) return;
+		
+		m_finished = true;
+		
+		if(m_compressBlocks && m_demux == NULL){
+			string eof;
+			
+			if(! BlockCompressor::appendEof(eof, m_cmprsType)){
+				cerr << "\nERROR: Compression of output failed.\n" << endl;
+				exit(1);
+			}
+			
+			m_blockFile.write(eof.data(), eof.size());
+			m_blockFile.close();
+			
+			if(m_blockFile.fail()){
+				cerr << "\nERROR: Could not write to file " << m_filePath << "\n" << endl;
+				exit(1);
+			}
+		}
+		else if(! m_useStdout && m_demux == NULL) close(seqFileOut);
+	}
+	
+	
 	const std::string getFileName(){
 		if(! m_useStdout) return m_filePath;
 		else              return "stdout";
@@ -85,6 +154,9 @@ public:
 		
 		using namespace std;
 		
+		// no files for barcodes without reads
+		if(m_demux != NULL && m_countGood == 0) return;
+		
 		string fname = m_filePath + ".lengthdist";
 		fstream lstream;
 		
@@ -98,16 +170,32 @@ public:
 			
 			for (int i = 0; i <= flexbar::MAX_READLENGTH; ++i){
 				if(m_lengthDist.at(i) > 0)
-					lstream << i << "\t" << m_lengthDist.at(i) << "\n";
+					lstream << i << "\t" << m_lengthDist.at(i).load() << "\n";
 			}
 			lstream.close();
 		}
 	}
 	
 	
-	void writeSeqRead(flexbar::TSeqRead &seqRead){
+	bool isStdout() const {
+		return m_useStdout;
+	}
+	
+	
+	unsigned int getBufferIdx() const {
+		return m_bufferIdx;
+	}
+	
+	
+	void setBufferIdx(const unsigned int idx){
+		m_bufferIdx = idx;
+	}
+	
+	
+	// appends record to buffer, called in parallel
+	
+	void formatSeqRead(flexbar::TSeqRead &seqRead, TString &buffer){
 		
-		using namespace std;
 		using namespace flexbar;
 		
 		if(m_useStdout && m_tagStr != ""){
@@ -115,13 +203,54 @@ public:
 			append(seqRead.id, m_tagStr);
 		}
 		
-		try{
-			if(m_format == FASTA || m_switch2Fasta){
-				writeRecord(seqFileOut, seqRead.id, seqRead.seq);
-			}
-			else{
-				writeRecord(seqFileOut, seqRead.id, seqRead.seq, seqRead.qual);
+		if(m_format == FASTA || m_switch2Fasta){
+			writeRecord(buffer, seqRead.id, seqRead.seq, seqan::Fasta());
+		}
+		else{
+			writeRecord(buffer, seqRead.id, seqRead.seq, seqRead.qual, seqan::Fastq());
+		}
+	}
+	
+	
+	// cuts records of bundle into compressed blocks, called in parallel
+	
+	void compressBuffer(const TString &buffer, std::string &blocks){
+		
+		using namespace std;
+		
+		if(! m_compressBlocks) return;
+		
+		if(! BlockCompressor::compress(blocks, begin(buffer, seqan::Standard()), length(buffer), m_cmprsType, m_zipLevel)){
+			cerr << "\nERROR: Compression of output failed.\n" << endl;
+			exit(1);
+		}
+	}
+	
+	
+	// writes formatted records or compressed blocks of bundle to file
+	
+	void writeBuffer(const TString &buffer, const std::string &blocks){
+		
+		using namespace std;
+		
+		if(m_demux != NULL){
+			if(m_compressBlocks) m_demux->write(m_demuxId, blocks.data(), blocks.size());
+			else                 m_demux->write(m_demuxId, begin(buffer, seqan::Standard()), length(buffer));
+			return;
+		}
+		
+		if(m_compressBlocks){
+			m_blockFile.write(blocks.data(), blocks.size());
+			
+			if(! m_blockFile.good()){
+				cerr << "\nERROR: Could not write to file " << m_filePath << "\n" << endl;
+				exit(1);
 			}
+			return;
+		}
+		
+		try{
+			write(seqFileOut.iter, buffer);
 		}
 		catch(seqan::Exception const &e){
 			cerr << "\nERROR: " << e.what() << "\nProgram execution aborted.\n" << endl;
@@ -141,22 +270,18 @@ public:
 	}
 	
 	
-	void* writeRead(void* item){
+	void formatRead(SeqRead<TSeqStr, TString> *seqRead, TString &buffer){
 		
 		using namespace std;
 		using namespace flexbar;
 		
-		if(item){
-			SeqRead<TSeqStr, TString> *seqRead = static_cast< SeqRead<TSeqStr, TString>* >(item);
+		if(seqRead != NULL){
 			
 			unsigned int readLength = length(seqRead->seq);
 			
 			if(m_cutLen_read > 1 && m_cutLen_read >= m_minLength && m_cutLen_read < readLength){
 				
-				seqRead->seq = prefix(seqRead->seq, m_cutLen_read);
-				
-				if(m_format == FASTQ)
-				seqRead->qual = prefix(seqRead->qual, m_cutLen_read);
+				seqRead->keepPrefix(m_cutLen_read);
 				
 				readLength = m_cutLen_read;
 			}
@@ -172,10 +297,8 @@ public:
 			else if(m_writeLenDist)
 				cerr << "\nCompile Flexbar with larger max read length to get correct length dist.\n" << endl;
 			
-			writeSeqRead(*seqRead);
+			formatSeqRead(*seqRead, buffer);
 		}
-		
-		return NULL;
 	}
 	
 };
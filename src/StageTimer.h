@@ -0,0 +1,50 @@
+// StageTimer.h
+
+#ifndef FLEXBAR_STAGETIMER_H
+#define FLEXBAR_STAGETIMER_H
+
+#include <chrono>
+#include <atomic>
+
+
+// Sums up the time spent in a stage of the pipeline. For serial stages the run
+// time minus busy time is reported, the stage waits for items from previous
+// stages or for tokens meanwhile, or is not scheduled.
+
+class StageTimer {
+
+private:
+	
+	std::atomic<unsigned long> m_busyTime;
+	
+public:
+	
+	StageTimer() :
+		m_busyTime(0){
+	};
+	
+	
+	template <typename TFilter>
+	void* run(TFilter &filter, void* item){
+		
+		using namespace std::chrono;
+		
+		steady_clock::time_point start = steady_clock::now();
+		
+		void* result = filter(item);
+		
+		m_busyTime += duration_cast<microseconds>(steady_clock::now() - start).count();
+		
+		return result;
+	}
+	
+	
+	// seconds summed over threads
+	
+	double getBusyTime() const {
+		return m_busyTime / 1e6;
+	}
+};
+
+
+#endif
@@ -0,0 +1,108 @@
+// ThreadPinning.h
+
+#ifndef FLEXBAR_THREADPINNING_H
+#define FLEXBAR_THREADPINNING_H
+
+#include <vector>
+#include <atomic>
+#include <tbb/task_arena.h>
+#include <tbb/task_scheduler_observer.h>
+
+#ifdef __linux__
+	#include <pthread.h>
+	#include <sched.h>
+#endif
+
+
+// Pins each thread entering the arena to one cpu of its affinity mask, which is
+// restricted to the cpus of a numa node for constrained arenas. Threads are
+// spread over cpus in order of entry and keep their cpu when entering again.
+// The mask of a thread is restored when it leaves the arena.
+
+class ThreadPinObserver : public tbb::task_scheduler_observer {
+
+private:
+	
+	std::atomic<unsigned int> m_nextThread;
+	
+#ifdef __linux__
+	struct PinState {
+		int cpu;
+		bool isSaved;
+		cpu_set_t saved;
+		
+		PinState() :
+			cpu(-1),
+			isSaved(false){
+			
+			CPU_ZERO(&saved);
+		}
+	};
+	
+	static PinState& getPinState(){
+		
+		static thread_local PinState state;
+		return state;
+	}
+#endif
+	
+public:
+	
+	ThreadPinObserver(tbb::task_arena &arena) :
+		tbb::task_scheduler_observer(arena),
+		m_nextThread(0){
+		
+		observe(true);
+	};
+	
+	
+	virtual ~ThreadPinObserver(){
+		observe(false);
+	};
+	
+	
+	void on_scheduler_entry(bool){
+		
+	#ifdef __linux__
+		PinState &state = getPinState();
+		
+		if(pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t), &state.saved) != 0) return;
+		
+		state.isSaved = true;
+		
+		if(state.cpu < 0){
+			
+			std::vector<int> allowed;
+			
+			for(int c = 0; c < CPU_SETSIZE; ++c)
+				if(CPU_ISSET(c, &state.saved)) allowed.push_back(c);
+			
+			if(allowed.size() == 0) return;
+			
+			state.cpu = allowed[m_nextThread++ % allowed.size()];
+		}
+		
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+		CPU_SET(state.cpu, &cpus);
+		
+		pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpus);
+	#endif
+	}
+	
+	
+	void on_scheduler_exit(bool){
+		
+	#ifdef __linux__
+		PinState &state = getPinState();
+		
+		if(! state.isSaved) return;
+		
+		pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &state.saved);
+		state.isSaved = false;
+	#endif
+	}
+};
+
+
+#endif
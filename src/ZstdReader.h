@@ -0,0 +1,88 @@
+// ZstdReader.h
+
+#ifndef FLEXBAR_ZSTDREADER_H
+#define FLEXBAR_ZSTDREADER_H
+
+#include <string>
+#include <vector>
+#include <zstd.h>
+
+#include "ChunkReader.h"
+
+
+// Decompression of zst files ahead of parsing in a background thread, files of
+// several concatenated frames are decompressed as one stream.
+
+class ZstdReader : public ChunkReader {
+
+protected:
+	
+	void run(){
+		
+		const size_t inSize = ZSTD_DStreamInSize(), outSize = 1 << 22;
+		
+		std::vector<char> in(inSize);
+		
+		ZSTD_DCtx *dctx = ZSTD_createDCtx();
+		
+		if(dctx == NULL) m_failed = true;
+		
+		// zero once last frame is complete
+		size_t status = 0;
+		
+		// decompressor may hold more data if chunk was filled
+		bool isFull = false;
+		
+		ZSTD_inBuffer input = { in.data(), 0, 0 };
+		
+		while(! m_failed && ! m_stop){
+			
+			if(input.pos == input.size && ! isFull){
+				m_file.read(in.data(), inSize);
+				
+				input.size = m_file.gcount();
+				input.pos  = 0;
+				
+				if(input.size == 0){
+					if(status != 0) m_failed = true;
+					break;
+				}
+			}
+			
+			std::string *chunk = new std::string(outSize, '\0');
+			
+			ZSTD_outBuffer output = { &(*chunk)[0], outSize, 0 };
+			
+			status = ZSTD_decompressStream(dctx, &output, &input);
+			
+			if(ZSTD_isError(status)){
+				delete chunk;
+				m_failed = true;
+				break;
+			}
+			
+			isFull = output.pos == outSize;
+			
+			chunk->resize(output.pos);
+			
+			if(chunk->size() == 0) delete chunk;
+			else                   m_chunks.push(chunk);
+		}
+		
+		ZSTD_freeDCtx(dctx);
+	}
+	
+public:
+	
+	ZstdReader() :
+		ChunkReader("zst"){
+	};
+	
+	
+	virtual ~ZstdReader(){
+		stop();
+	};
+};
+
+
+#endif
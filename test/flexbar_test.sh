@@ -8,6 +8,18 @@ echo "Testing fasta:"
 echo "Testing fastq:"
 ./flexbar_test_fastq.sh
 
-echo "Testing decompression:"
+echo "Testing compression:"
 ./flexbar_test_zip.sh
 
+echo "Testing alignment engines:"
+./flexbar_test_align.sh
+
+echo "Testing barcodes:"
+./flexbar_test_barcode.sh
+
+echo "Testing paired reads:"
+./flexbar_test_paired.sh
+
+echo "Testing pipeline:"
+./flexbar_test_pipeline.sh
+
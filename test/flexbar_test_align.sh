@@ -0,0 +1,150 @@
+#!/bin/sh -e
+
+flexbar --reads reads_tie.fasta --target result_tie_seqan --adapter-min-overlap 3 --adapters adapters.fasta --min-read-length 10 --adapter-error-rate 0.2 --adapter-trim-end RIGHT --align-engine SEQAN > /dev/null
+flexbar --reads reads_tie.fasta --target result_tie_dp --adapter-min-overlap 3 --adapters adapters.fasta --min-read-length 10 --adapter-error-rate 0.2 --adapter-trim-end RIGHT --align-engine DP > /dev/null
+
+a=`diff result_tie_seqan.fasta result_tie_dp.fasta`
+
+if ! $a ; then
+echo "Error testing tied end cells right mode"
+echo $a
+exit 1
+else
+echo "Test 1 OK"
+fi
+
+
+flexbar --reads reads_tie.fasta --target result_tie_seqan --adapter-min-overlap 3 --adapters adapters.fasta --min-read-length 10 --adapter-error-rate 0.2 --adapter-trim-end LEFT --align-engine SEQAN > /dev/null
+flexbar --reads reads_tie.fasta --target result_tie_dp --adapter-min-overlap 3 --adapters adapters.fasta --min-read-length 10 --adapter-error-rate 0.2 --adapter-trim-end LEFT --align-engine DP > /dev/null
+
+a=`diff result_tie_seqan.fasta result_tie_dp.fasta`
+
+if ! $a ; then
+echo "Error testing tied end cells left mode"
+echo $a
+exit 1
+else
+echo "Test 2 OK"
+fi
+
+
+flexbar --reads reads_tie.fasta --target result_tie_seqan --adapter-min-overlap 3 --adapters adapters.fasta --min-read-length 10 --adapter-error-rate 0.2 --adapter-trim-end ANY --align-engine SEQAN > /dev/null
+flexbar --reads reads_tie.fasta --target result_tie_dp --adapter-min-overlap 3 --adapters adapters.fasta --min-read-length 10 --adapter-error-rate 0.2 --adapter-trim-end ANY --align-engine DP > /dev/null
+
+a=`diff result_tie_seqan.fasta result_tie_dp.fasta`
+
+if ! $a ; then
+echo "Error testing tied end cells any mode"
+echo $a
+exit 1
+else
+echo "Test 3 OK"
+fi
+
+
+flexbar --reads reads.fastq --target result_band_right --adapter-min-overlap 4 --adapters adapters.fasta --min-read-length 10 --adapter-error-rate 0.1 --adapter-trim-end RIGHT --adapter-band > /dev/null
+
+a=`diff correct_result_right.fastq result_band_right.fastq`
+
+if ! $a ; then
+echo "Error testing banded alignment right mode"
+echo $a
+exit 1
+else
+echo "Test 4 OK"
+fi
+
+
+flexbar --reads reads.fastq --target result_band_left --adapter-min-overlap 4 --adapters adapters.fasta --min-read-length 10 --adapter-error-rate 0.1 --adapter-trim-end LEFT --adapter-band > /dev/null
+
+a=`diff correct_result_left.fastq result_band_left.fastq`
+
+if ! $a ; then
+echo "Error testing banded alignment left mode"
+echo $a
+exit 1
+else
+echo "Test 5 OK"
+fi
+
+
+flexbar --reads reads.fastq --target result_myers_right --adapter-min-overlap 4 --adapters adapters.fasta --min-read-length 10 --adapter-error-rate 0.1 --adapter-trim-end RIGHT --align-engine MYERS > /dev/null
+
+a=`diff correct_result_right.fastq result_myers_right.fastq`
+
+if ! $a ; then
+echo "Error testing myers engine right mode"
+echo $a
+exit 1
+else
+echo "Test 6 OK"
+fi
+
+
+flexbar --reads reads.fastq --target result_myers_left --adapter-min-overlap 4 --adapters adapters.fasta --min-read-length 10 --adapter-error-rate 0.1 --adapter-trim-end LEFT --align-engine MYERS > /dev/null
+
+a=`diff correct_result_left.fastq result_myers_left.fastq`
+
+if ! $a ; then
+echo "Error testing myers engine left mode"
+echo $a
+exit 1
+else
+echo "Test 7 OK"
+fi
+
+
+flexbar --reads reads.fastq --target result_seed_right --adapter-min-overlap 4 --adapters adapters.fasta --min-read-length 10 --adapter-error-rate 0.1 --adapter-trim-end RIGHT --seed-filter > /dev/null
+
+a=`diff correct_result_right.fastq result_seed_right.fastq`
+
+if ! $a ; then
+echo "Error testing seed filter right mode"
+echo $a
+exit 1
+else
+echo "Test 8 OK"
+fi
+
+
+flexbar --reads reads.fastq --target result_seed_any --adapter-min-overlap 4 --adapters adapters.fasta --min-read-length 10 --adapter-error-rate 0.1 --adapter-trim-end ANY --seed-filter > /dev/null
+
+a=`diff correct_result_any.fastq result_seed_any.fastq`
+
+if ! $a ; then
+echo "Error testing seed filter any mode"
+echo $a
+exit 1
+else
+echo "Test 9 OK"
+fi
+
+
+flexbar --reads reads.fastq --target result_ungapped --adapter-min-overlap 4 --adapters adapters.fasta --min-read-length 10 --adapter-error-rate 0.1 --adapter-trim-end RIGHT --adapter-ungapped > /dev/null
+
+a=`diff correct_result_right.fastq result_ungapped.fastq`
+
+if ! $a ; then
+echo "Error testing ungapped alignment right mode"
+echo $a
+exit 1
+else
+echo "Test 10 OK"
+fi
+
+
+flexbar --reads reads.fastq --target result_multi_seed --adapter-min-overlap 4 --adapters adapters_multi.fasta --min-read-length 10 --adapter-error-rate 0.1 --adapter-trim-end RIGHT --seed-filter > /dev/null
+flexbar --reads reads.fastq --target result_multi_dp --adapter-min-overlap 4 --adapters adapters_multi.fasta --min-read-length 10 --adapter-error-rate 0.1 --adapter-trim-end RIGHT > /dev/null
+
+a=`diff result_multi_seed.fastq result_multi_dp.fastq`
+
+if ! $a ; then
+echo "Error testing seed scan of several adapters"
+echo $a
+exit 1
+else
+echo "Test 11 OK"
+fi
+
+echo ""
+
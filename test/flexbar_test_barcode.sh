@@ -0,0 +1,93 @@
+#!/bin/sh -e
+
+flexbar --reads reads1.fasta --target result_bc_dp --barcodes barcodes.fasta --barcode-trim-end RTAIL --barcode-unassigned --min-read-length 10 > /dev/null
+flexbar --reads reads1.fasta --target result_bc_hash --barcodes barcodes.fasta --barcode-trim-end RTAIL --barcode-unassigned --min-read-length 10 --barcode-hash > /dev/null
+
+for b in Barcode1 Barcode2 unassigned; do
+
+a=`diff result_bc_dp_barcode_$b.fasta result_bc_hash_barcode_$b.fasta`
+
+if ! $a ; then
+echo "Error testing barcode hash lookup $b"
+echo $a
+exit 1
+fi
+
+done
+
+echo "Test 1 OK"
+
+
+flexbar --reads reads1.fasta --target result_bc_dp2 --barcodes barcodes.fasta --barcode-trim-end RTAIL --barcode-unassigned --min-read-length 10 --barcode-error-rate 0.2 > /dev/null
+flexbar --reads reads1.fasta --target result_bc_trie --barcodes barcodes.fasta --barcode-trim-end RTAIL --barcode-unassigned --min-read-length 10 --barcode-error-rate 0.2 --barcode-trie > /dev/null
+
+for b in Barcode1 Barcode2 unassigned; do
+
+a=`diff result_bc_dp2_barcode_$b.fasta result_bc_trie_barcode_$b.fasta`
+
+if ! $a ; then
+echo "Error testing barcode trie $b"
+echo $a
+exit 1
+fi
+
+done
+
+echo "Test 2 OK"
+
+
+flexbar --reads reads_rs.fasta --target result_rs_dp --barcodes barcodes.fasta --barcode-trim-end LTAIL --min-read-length 10 > /dev/null
+flexbar --reads reads_rs.fasta --target result_rs --barcodes barcodes.fasta --read-structure 8B+T --min-read-length 10 > /dev/null
+
+a=`diff result_rs_dp_barcode_Barcode2.fasta result_rs_barcode_Barcode2.fasta`
+
+if ! $a ; then
+echo "Error testing read structure"
+echo $a
+exit 1
+else
+echo "Test 3 OK"
+fi
+
+
+flexbar --reads reads_rs.fasta --target result_rs_dp_keep --barcodes barcodes.fasta --barcode-trim-end LTAIL --barcode-keep --min-read-length 10 > /dev/null
+flexbar --reads reads_rs.fasta --target result_rs_keep --barcodes barcodes.fasta --read-structure 8B+T --barcode-keep --min-read-length 10 > /dev/null
+
+a=`diff result_rs_dp_keep_barcode_Barcode2.fasta result_rs_keep_barcode_Barcode2.fasta`
+
+if ! $a ; then
+echo "Error testing read structure with barcode keep"
+echo $a
+exit 1
+else
+echo "Test 4 OK"
+fi
+
+
+flexbar --reads reads1.fasta --target result_bc_files --barcodes barcodes.fasta --barcode-trim-end RTAIL --barcode-unassigned --min-read-length 10 --barcode-open-files 1 > /dev/null
+flexbar --reads reads1.fasta --target result_bc_zip --barcodes barcodes.fasta --barcode-trim-end RTAIL --barcode-unassigned --min-read-length 10 --barcode-open-files 1 --zip-output GZ --threads 2 > /dev/null
+
+for b in Barcode1 Barcode2 unassigned; do
+
+a=`diff result_bc_dp_barcode_$b.fasta result_bc_files_barcode_$b.fasta`
+
+if ! $a ; then
+echo "Error testing barcode output with one open file $b"
+echo $a
+exit 1
+fi
+
+a=`zcat result_bc_zip_barcode_$b.fasta.gz | diff result_bc_dp_barcode_$b.fasta -`
+
+if ! $a ; then
+echo "Error testing compressed barcode output $b"
+echo $a
+exit 1
+fi
+
+done
+
+echo "Test 5 OK"
+
+echo ""
+
@@ -64,5 +64,18 @@ else
 echo "Test 5 OK"
 fi
 
+
+flexbar --reads - --target result_stdin --adapter-min-overlap 4 --adapters adapters.fasta --min-read-length 10 --adapter-error-rate 0.1 --adapter-trim-end RIGHT < reads.fastq > /dev/null
+
+a=`diff correct_result_right.fastq result_stdin.fastq`
+
+if ! $a ; then
+echo "Error testing stdin input fastq"
+echo $a
+exit 1
+else
+echo "Test 6 OK"
+fi
+
 echo ""
 
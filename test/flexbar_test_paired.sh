@@ -0,0 +1,26 @@
+#!/bin/sh -e
+
+flexbar --reads reads1.fasta --reads2 reads2.fasta --target result_paired --adapters adapters_multi.fasta --adapter-min-overlap 4 --min-read-length 10 --adapter-error-rate 0.1 --adapter-trim-end RIGHT > /dev/null
+flexbar --reads reads1.fasta --target result_single1 --adapters adapters_multi.fasta --adapter-min-overlap 4 --min-read-length 10 --adapter-error-rate 0.1 --adapter-trim-end RIGHT > /dev/null
+flexbar --reads reads2.fasta --target result_single2 --adapters adapters_multi.fasta --adapter-min-overlap 4 --min-read-length 10 --adapter-error-rate 0.1 --adapter-trim-end RIGHT > /dev/null
+
+a=`diff result_single1.fasta result_paired_1.fasta`
+
+if ! $a ; then
+echo "Error testing paired reads 1"
+echo $a
+exit 1
+fi
+
+a=`diff result_single2.fasta result_paired_2.fasta`
+
+if ! $a ; then
+echo "Error testing paired reads 2"
+echo $a
+exit 1
+else
+echo "Test 1 OK"
+fi
+
+echo ""
+
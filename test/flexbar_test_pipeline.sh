@@ -0,0 +1,45 @@
+#!/bin/sh -e
+
+flexbar --reads reads.fastq --target result_tokens --adapter-min-overlap 4 --adapters adapters.fasta --min-read-length 10 --adapter-error-rate 0.1 --adapter-trim-end RIGHT --threads 2 --bundle 2 --tokens 3 --max-memory 1 > /dev/null
+
+a=`diff correct_result_right.fastq result_tokens.fastq`
+
+if ! $a ; then
+echo "Error testing bundles in flight and memory limit"
+echo $a
+exit 1
+else
+echo "Test 1 OK"
+fi
+
+
+flexbar --reads reads.fastq --target result_pinned --adapter-min-overlap 4 --adapters adapters.fasta --min-read-length 10 --adapter-error-rate 0.1 --adapter-trim-end RIGHT --threads 2 --bundle 2 --pin-threads > /dev/null
+
+a=`diff correct_result_right.fastq result_pinned.fastq`
+
+if ! $a ; then
+echo "Error testing pinned threads"
+echo $a
+exit 1
+else
+echo "Test 2 OK"
+fi
+
+
+flexbar --reads reads.fastq --target result_unordered --adapter-min-overlap 4 --adapters adapters.fasta --min-read-length 10 --adapter-error-rate 0.1 --adapter-trim-end RIGHT --threads 4 --bundle 2 --unordered-output > /dev/null
+
+paste - - - - < correct_result_right.fastq | sort > result_unordered_expected.txt
+paste - - - - < result_unordered.fastq | sort > result_unordered_sorted.txt
+
+a=`diff result_unordered_expected.txt result_unordered_sorted.txt`
+
+if ! $a ; then
+echo "Error testing unordered output"
+echo $a
+exit 1
+else
+echo "Test 3 OK"
+fi
+
+echo ""
+
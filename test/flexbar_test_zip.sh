@@ -25,5 +25,105 @@ else
 echo "Test bzip2 OK"
 fi
 
+
+flexbar --reads reads.fastq.gz --target result_gz_threads --adapter-min-overlap 4 --adapters adapters.fasta --min-read-length 10 --adapter-error-rate 0.1 --adapter-trim-end RIGHT --gzip-threads 2 > /dev/null
+
+a=`diff correct_result_right.fastq result_gz_threads.fastq`
+
+if ! $a ; then
+echo "Error testing right mode gzip fastq with gzip threads"
+echo $a
+exit 1
+else
+echo "Test gzip threads OK"
+fi
+
+
+flexbar --reads reads_multi.fastq.gz --target result_multi --adapter-min-overlap 4 --adapters adapters.fasta --min-read-length 10 --adapter-error-rate 0.1 --adapter-trim-end RIGHT --gzip-threads 2 > /dev/null
+
+a=`diff correct_result_right.fastq result_multi.fastq`
+
+if ! $a ; then
+echo "Error testing right mode multi-member gzip fastq with gzip threads"
+echo $a
+exit 1
+else
+echo "Test gzip members OK"
+fi
+
+
+flexbar --reads reads_bgzf.fastq.gz --target result_bgzf --adapter-min-overlap 4 --adapters adapters.fasta --min-read-length 10 --adapter-error-rate 0.1 --adapter-trim-end RIGHT --gzip-threads 2 > /dev/null
+
+a=`diff correct_result_right.fastq result_bgzf.fastq`
+
+if ! $a ; then
+echo "Error testing right mode bgzf fastq with gzip threads"
+echo $a
+exit 1
+else
+echo "Test bgzf OK"
+fi
+
+
+flexbar --reads reads.fastq --target result_out_gz --adapter-min-overlap 4 --adapters adapters.fasta --min-read-length 10 --adapter-error-rate 0.1 --adapter-trim-end RIGHT --zip-output GZ --threads 2 --zip-level 6 > /dev/null
+
+a=`zcat result_out_gz.fastq.gz | diff correct_result_right.fastq -`
+
+if ! $a ; then
+echo "Error testing block compressed gzip output"
+echo $a
+exit 1
+else
+echo "Test gzip output OK"
+fi
+
+
+flexbar --reads reads.fastq --target result_out_bz2 --adapter-min-overlap 4 --adapters adapters.fasta --min-read-length 10 --adapter-error-rate 0.1 --adapter-trim-end RIGHT --zip-output BZ2 --zip-level 9 > /dev/null
+
+a=`bzcat result_out_bz2.fastq.bz2 | diff correct_result_right.fastq -`
+
+if ! $a ; then
+echo "Error testing block compressed bzip2 output"
+echo $a
+exit 1
+else
+echo "Test bzip2 output OK"
+fi
+
+
+# zst is optional at build time, output of probe is decompressed by zstdcat
+flexbar --reads reads.fastq --target result_zst_probe --adapter-min-overlap 4 --adapters adapters.fasta --min-read-length 10 --adapter-error-rate 0.1 --adapter-trim-end RIGHT --zip-output ZST > /dev/null 2>&1
+
+if [ $? -ne 0 ] || ! command -v zstdcat > /dev/null ; then
+echo "Skipping zstd tests, zstd support or zstdcat not available"
+else
+
+flexbar --reads reads.fastq.zst --target result_zst --adapter-min-overlap 4 --adapters adapters.fasta --min-read-length 10 --adapter-error-rate 0.1 --adapter-trim-end RIGHT > /dev/null
+
+a=`diff correct_result_right.fastq result_zst.fastq`
+
+if ! $a ; then
+echo "Error testing right mode zstd fastq"
+echo $a
+exit 1
+else
+echo "Test zstd OK"
+fi
+
+
+flexbar --reads reads.fastq --target result_out_zst --adapter-min-overlap 4 --adapters adapters.fasta --min-read-length 10 --adapter-error-rate 0.1 --adapter-trim-end RIGHT --zip-output ZST --threads 2 --zip-level 19 > /dev/null
+
+a=`zstdcat result_out_zst.fastq.zst | diff correct_result_right.fastq -`
+
+if ! $a ; then
+echo "Error testing zstd output"
+echo $a
+exit 1
+else
+echo "Test zstd output OK"
+fi
+
+fi
+
 echo ""
 